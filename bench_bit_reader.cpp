@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bit_reader.h"
+
+// Compares bit_reader.h with the per-bit reader it replaced, on the same
+// mix of field widths, signed fields and byte alignment that shape
+// records produce. Both readers must return identical values.
+
+// The reader swf_extractor and shape_to_svg used before bit_reader.h
+class PerBitReader {
+    const uint8_t* data;
+    size_t bytePos;
+    int bitPos;
+    size_t size;
+
+public:
+    PerBitReader(const uint8_t* d, size_t s) : data(d), bytePos(0), bitPos(0), size(s) {}
+
+    uint32_t readBits(int numBits) {
+        uint32_t result = 0;
+        for (int i = 0; i < numBits; i++) {
+            if (bytePos >= size) return result;
+            int bit = (data[bytePos] >> (7 - bitPos)) & 1;
+            result = (result << 1) | bit;
+            bitPos++;
+            if (bitPos == 8) {
+                bitPos = 0;
+                bytePos++;
+            }
+        }
+        return result;
+    }
+
+    int32_t readSignedBits(int numBits) {
+        uint32_t val = readBits(numBits);
+        if (val & (1 << (numBits - 1))) {
+            return val | (~0u << numBits);
+        }
+        return val;
+    }
+
+    void alignByte() {
+        if (bitPos != 0) {
+            bitPos = 0;
+            bytePos++;
+        }
+    }
+};
+
+// One read of the workload: width > 0 reads unsigned, < 0 signed, 0 aligns
+struct Op {
+    int width;
+};
+
+template <typename Reader>
+static double run(const std::vector<uint8_t>& buffer, const std::vector<Op>& ops, int passes, uint64_t& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        Reader br(buffer.data(), buffer.size());
+        for (const Op& op : ops) {
+            if (op.width > 0) checksum = checksum * 31 + br.readBits(op.width);
+            else if (op.width < 0) checksum = checksum * 31 + (uint32_t)br.readSignedBits(-op.width);
+            else br.alignByte();
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    int passes = argc > 2 ? std::atoi(argv[2]) : 10;
+    if (megabytes == 0 || passes < 1) {
+        std::cout << "Usage: " << argv[0] << " [megabytes] [passes]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> buffer(megabytes << 20);
+    for (uint8_t& b : buffer) b = (uint8_t)rng();
+
+    // Flags of 1-5 bits, coordinates of 2-20 bits (half signed), and an
+    // alignment now and then, like style changes and edges
+    std::vector<Op> ops;
+    uint64_t bits = 0;
+    while (bits + 64 < buffer.size() * 8) {
+        uint32_t r = rng();
+        int width;
+        if (r % 64 == 0) {
+            ops.push_back(Op{0});
+            bits = (bits + 7) & ~(uint64_t)7;
+            continue;
+        } else if (r % 3 == 0) {
+            width = 1 + (r >> 8) % 5;
+        } else {
+            width = 2 + (r >> 8) % 19;
+            if (r & 0x80) width = -width;
+        }
+        ops.push_back(Op{width});
+        bits += width < 0 ? -width : width;
+    }
+
+    uint64_t oldSum = 0, newSum = 0;
+    double oldTime = run<PerBitReader>(buffer, ops, passes, oldSum);
+    double newTime = run<BitReader>(buffer, ops, passes, newSum);
+
+    double totalBits = (double)bits * passes;
+    double reads = (double)ops.size() * passes;
+    printf("%zu MiB x %d passes, %zu reads per pass\n", megabytes, passes, ops.size());
+    printf("per-bit reader:   %8.1f Mbit/s  %6.2f ns/read\n", totalBits / oldTime / 1e6, oldTime / reads * 1e9);
+    printf("bit_reader.h:     %8.1f Mbit/s  %6.2f ns/read\n", totalBits / newTime / 1e6, newTime / reads * 1e9);
+    printf("speedup:          %8.1fx\n", oldTime / newTime);
+    if (oldSum != newSum) {
+        std::cerr << "Readers disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "unpremultiply.h"
+
+// Checks the unpremultiply kernels in unpremultiply.h against the scalar
+// reference and times each one. The checks cover every (alpha, channel)
+// pair, every tail length the vector loops can leave, and unaligned
+// starts; the kernels must produce identical bytes and leave the bytes
+// after the last pixel alone.
+
+typedef void (*Kernel)(uint8_t*, size_t);
+
+struct NamedKernel {
+    const char* name;
+    Kernel run;
+};
+
+// Exact c * 255 / a rounded half up, clamped, 0 when a is 0
+static uint8_t exactChannel(uint8_t c, uint8_t a) {
+    if (a == 0) return 0;
+    unsigned v = (2u * c * 255 + a) / (2u * a);
+    return v > 255 ? 255 : (uint8_t)v;
+}
+
+// Runs kernel on count pixels copied from src, starting offset bytes into
+// a guarded buffer, and compares them with the scalar reference
+static bool matchesReference(const NamedKernel& kernel, const std::vector<uint8_t>& src, size_t count, size_t offset) {
+    const size_t guard = 64;
+    std::vector<uint8_t> expected(src.begin(), src.begin() + count * 4);
+    argbToRgbaScalar(expected.data(), count);
+
+    std::vector<uint8_t> buffer(offset + count * 4 + guard, 0xA5);
+    uint8_t* pixels = buffer.data() + offset;
+    memcpy(pixels, src.data(), count * 4);
+    kernel.run(pixels, count);
+
+    if (count > 0 && memcmp(pixels, expected.data(), count * 4) != 0) {
+        for (size_t i = 0; i < count * 4; i++) {
+            if (pixels[i] != expected[i]) {
+                printf("%s: pixel %zu byte %zu is %d, expected %d (count %zu, offset %zu)\n", kernel.name, i / 4, i % 4,
+                       pixels[i], expected[i], count, offset);
+                break;
+            }
+        }
+        return false;
+    }
+    for (size_t i = 0; i < offset; i++) {
+        if (buffer[i] != 0xA5) {
+            printf("%s: wrote before the first pixel (count %zu, offset %zu)\n", kernel.name, count, offset);
+            return false;
+        }
+    }
+    for (size_t i = offset + count * 4; i < buffer.size(); i++) {
+        if (buffer[i] != 0xA5) {
+            printf("%s: wrote past the last pixel (count %zu, offset %zu)\n", kernel.name, count, offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int passes = argc > 1 ? std::atoi(argv[1]) : 10;
+    if (passes < 1) {
+        std::cout << "Usage: " << argv[0] << " [passes]" << std::endl;
+        return 1;
+    }
+
+    std::vector<NamedKernel> kernels;
+    kernels.push_back(NamedKernel{"scalar", argbToRgbaScalar});
+#ifdef SWF_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) kernels.push_back(NamedKernel{"sse2", argbToRgbaSSE2});
+    else printf("sse2: not supported by this CPU, skipped\n");
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(NamedKernel{"avx2", argbToRgbaAVX2});
+    else printf("avx2: not supported by this CPU, skipped\n");
+#endif
+    kernels.push_back(NamedKernel{"auto", argbToRgba});
+
+    // The reference itself against exact integer rounding
+    bool ok = true;
+    for (int a = 0; a < 256; a++) {
+        for (int c = 0; c < 256; c++) {
+            if (unpremultiplyChannel((uint8_t)c, (uint8_t)a) != exactChannel((uint8_t)c, (uint8_t)a)) {
+                printf("reference: a=%d c=%d gives %d, expected %d\n", a, c, unpremultiplyChannel((uint8_t)c, (uint8_t)a),
+                       exactChannel((uint8_t)c, (uint8_t)a));
+                ok = false;
+            }
+        }
+    }
+
+    // One pixel per (alpha, channel) pair, with the channel value placed
+    // differently in R, G and B so every lane sees every pair
+    std::vector<uint8_t> pairs(256 * 256 * 4);
+    for (size_t i = 0; i < 256 * 256; i++) {
+        uint8_t a = (uint8_t)(i >> 8), c = (uint8_t)i;
+        pairs[i * 4 + 0] = a;
+        pairs[i * 4 + 1] = c;
+        pairs[i * 4 + 2] = (uint8_t)(255 - c);
+        pairs[i * 4 + 3] = (uint8_t)(c ^ 0x5A);
+    }
+
+    // Tails and unaligned starts use pixels from all over the pair table
+    std::mt19937 rng(1);
+    std::vector<uint8_t> mixed(64 * 4);
+    for (size_t i = 0; i < 64; i++) {
+        size_t p = rng() % (256 * 256);
+        memcpy(&mixed[i * 4], &pairs[p * 4], 4);
+    }
+
+    for (const NamedKernel& kernel : kernels) {
+        bool kernelOk = true;
+        for (size_t offset = 0; offset < 8; offset++) {
+            kernelOk &= matchesReference(kernel, pairs, 256 * 256 + (offset ? 3 : 0), offset);
+        }
+        for (size_t count = 0; count <= 40; count++) {
+            for (size_t offset = 0; offset < 8; offset++) {
+                kernelOk &= matchesReference(kernel, mixed, count, offset);
+            }
+        }
+        printf("%-7s %s\n", kernel.name, kernelOk ? "matches reference" : "MISMATCH");
+        ok &= kernelOk;
+    }
+
+    // Throughput on a 4096x4096 image of valid premultiplied pixels
+    const size_t count = 4096 * 4096;
+    std::vector<uint8_t> image(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t a = (uint8_t)rng();
+        image[i * 4] = a;
+        for (int k = 1; k < 4; k++) image[i * 4 + k] = (uint8_t)(a ? rng() % (a + 1u) : 0);
+    }
+    std::vector<uint8_t> work(count * 4);
+    for (const NamedKernel& kernel : kernels) {
+        double seconds = 0;
+        for (int pass = 0; pass < passes; pass++) {
+            memcpy(work.data(), image.data(), work.size());
+            auto start = std::chrono::steady_clock::now();
+            kernel.run(work.data(), count);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        printf("%-7s %8.1f Mpixel/s\n", kernel.name, (double)count * passes / seconds / 1e6);
+    }
+
+    if (!ok) {
+        std::cerr << "Kernels disagree with the reference" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef BIT_READER_H
+#define BIT_READER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// ==========================================
+// Bit Manipulation
+// ==========================================
+
+// MSB-first bit reader shared by swf_extractor and shape_to_svg.
+//
+// Bits are buffered left-aligned in a 64-bit accumulator that is refilled
+// eight bytes at a time, so readBits() is a shift and a mask instead of a
+// loop with a bounds check per bit. Bits below the valid region may hold
+// the true stream bits from a previous refill; OR-ing them in again is
+// harmless because they can only ever be the same values.
+//
+// Reading past the end yields zero bits and sets overran(), which is
+// checked once per refill rather than once per bit.
+class BitReader {
+    const uint8_t* data;
+    size_t size;
+    size_t nextByte;     // Next byte to load into the accumulator
+    uint64_t acc;        // Buffered bits, most significant first
+    int accBits;         // Number of valid bits at the top of acc
+    uint64_t bitPos;     // Bits consumed from the start of data
+    bool overrun;
+
+    void refill(int need) {
+        if (nextByte + 8 <= size) {
+            uint64_t word = 0;
+            for (int i = 0; i < 8; i++) {
+                word = (word << 8) | data[nextByte + i];
+            }
+            acc |= word >> accBits;
+            int bytes = (63 - accBits) >> 3;
+            nextByte += bytes;
+            accBits += bytes * 8;
+        } else {
+            while (accBits <= 56 && nextByte < size) {
+                acc |= (uint64_t)data[nextByte++] << (56 - accBits);
+                accBits += 8;
+            }
+        }
+        if (accBits < need) {
+            // Missing bits read as zero
+            overrun = true;
+            accBits = need;
+        }
+    }
+
+public:
+    BitReader(const uint8_t* d, size_t s)
+        : data(d), size(s), nextByte(0), acc(0), accBits(0), bitPos(0), overrun(false) {}
+
+    // numBits may be 0..32
+    uint32_t readBits(int numBits) {
+        if (numBits <= 0) return 0;
+        if (accBits < numBits) refill(numBits);
+        uint32_t result = (uint32_t)(acc >> (64 - numBits));
+        acc <<= numBits;
+        accBits -= numBits;
+        bitPos += numBits;
+        return result;
+    }
+
+    int32_t readSignedBits(int numBits) {
+        if (numBits <= 0) return 0;
+        uint32_t val = readBits(numBits);
+        if (numBits < 32 && (val & (1u << (numBits - 1)))) {
+            return (int32_t)(val | (~0u << numBits));
+        }
+        return (int32_t)val;
+    }
+
+    void alignByte() {
+        int partial = (int)(bitPos & 7);
+        if (partial != 0) readBits(8 - partial);
+    }
+
+    size_t getBytePos() const { return (size_t)(bitPos >> 3); }
+
+    void setBytePos(size_t pos) {
+        nextByte = pos;
+        acc = 0;
+        accBits = 0;
+        bitPos = (uint64_t)pos << 3;
+    }
+
+    bool overran() const { return overrun; }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef SHAPE_RECORDS_H
+#define SHAPE_RECORDS_H
+
+#include <cstdint>
+
+#include "bit_reader.h"
+
+// ==========================================
+// Shape Records
+// ==========================================
+//
+// Decoder for the SHAPERECORD list shared by DefineShape1-4 and font
+// glyphs, used by swf_extractor and shape_to_svg. It yields one record at
+// a time into a caller-owned struct and never allocates, so a glyph table
+// can be walked on several threads at once.
+//
+// Coordinates are absolute, in the shape's units (twips for shapes).
+// A style change that brings new fill and line style arrays
+// (hasNewStyles) leaves the reader at those arrays: the caller parses
+// them and then calls readStyleBits() before asking for the next record.
+
+struct ShapeRecord {
+    enum Type { END, STYLE_CHANGE, STRAIGHT_EDGE, CURVED_EDGE };
+
+    Type type;
+    bool hasMove;               // Style change fields that are present
+    bool hasFill0;
+    bool hasFill1;
+    bool hasLine;
+    bool hasNewStyles;
+    uint32_t fill0;
+    uint32_t fill1;
+    uint32_t line;
+    int32_t fromX;              // Pen position before the record
+    int32_t fromY;
+    int32_t x;                  // and after it
+    int32_t y;
+    int32_t controlX;           // Curved edges only
+    int32_t controlY;
+};
+
+class ShapeRecordDecoder {
+    BitReader& br;
+    int fillBits;
+    int lineBits;
+    int32_t penX;
+    int32_t penY;
+
+public:
+    explicit ShapeRecordDecoder(BitReader& reader) : br(reader), fillBits(0), lineBits(0), penX(0), penY(0) {}
+
+    // NumFillBits and NumLineBits, which precede the records and follow
+    // every set of new styles
+    void readStyleBits() {
+        br.alignByte();
+        fillBits = br.readBits(4);
+        lineBits = br.readBits(4);
+    }
+
+    // Reads the next record; false at the end record or when the data
+    // runs out
+    bool next(ShapeRecord& rec) {
+        rec.fromX = rec.x = penX;
+        rec.fromY = rec.y = penY;
+        if (!br.readBits(1)) {
+            uint32_t flags = br.readBits(5);
+            if (flags == 0 || br.overran()) {
+                rec.type = ShapeRecord::END;
+                return false;
+            }
+            rec.type = ShapeRecord::STYLE_CHANGE;
+            rec.hasMove = flags & 0x01;
+            rec.hasFill0 = flags & 0x02;
+            rec.hasFill1 = flags & 0x04;
+            rec.hasLine = flags & 0x08;
+            rec.hasNewStyles = flags & 0x10;
+            if (rec.hasMove) {
+                int nBits = br.readBits(5);
+                penX = rec.x = br.readSignedBits(nBits);
+                penY = rec.y = br.readSignedBits(nBits);
+            }
+            rec.fill0 = rec.hasFill0 ? br.readBits(fillBits) : 0;
+            rec.fill1 = rec.hasFill1 ? br.readBits(fillBits) : 0;
+            rec.line = rec.hasLine ? br.readBits(lineBits) : 0;
+            if (rec.hasNewStyles) br.alignByte();
+        } else if (br.readBits(1)) {
+            rec.type = ShapeRecord::STRAIGHT_EDGE;
+            int nBits = br.readBits(4) + 2;
+            if (br.readBits(1)) {
+                penX += br.readSignedBits(nBits);
+                penY += br.readSignedBits(nBits);
+            } else if (br.readBits(1)) {
+                penY += br.readSignedBits(nBits);
+            } else {
+                penX += br.readSignedBits(nBits);
+            }
+            rec.x = penX;
+            rec.y = penY;
+        } else {
+            rec.type = ShapeRecord::CURVED_EDGE;
+            int nBits = br.readBits(4) + 2;
+            rec.controlX = penX + br.readSignedBits(nBits);
+            rec.controlY = penY + br.readSignedBits(nBits);
+            penX = rec.x = rec.controlX + br.readSignedBits(nBits);
+            penY = rec.y = rec.controlY + br.readSignedBits(nBits);
+        }
+        return !br.overran();
+    }
+};
+
+#endif
@@ -10,6 +10,9 @@
 #include <list>
 #include <algorithm>
 
+#include "bit_reader.h"
+#include "shape_records.h"
+
 // ==========================================
 // Basic Structures
 // ==========================================
@@ -85,53 +88,6 @@ struct Edge {
     }
 };
 
-// ==========================================
-// Bit Manipulation
-// ==========================================
-
-class BitReader {
-    const uint8_t* data;
-    size_t bytePos;
-    int bitPos;
-    size_t size;
-
-public:
-    BitReader(const uint8_t* d, size_t s) : data(d), bytePos(0), bitPos(0), size(s) {}
-    
-    uint32_t readBits(int numBits) {
-        uint32_t result = 0;
-        for (int i = 0; i < numBits; i++) {
-            if (bytePos >= size) return result;
-            int bit = (data[bytePos] >> (7 - bitPos)) & 1;
-            result = (result << 1) | bit;
-            bitPos++;
-            if (bitPos == 8) {
-                bitPos = 0;
-                bytePos++;
-            }
-        }
-        return result;
-    }
-    
-    int32_t readSignedBits(int numBits) {
-        uint32_t val = readBits(numBits);
-        if (val & (1 << (numBits - 1))) {
-            return val | (0xFFFFFFFF << numBits); 
-        }
-        return val;
-    }
-    
-    void alignByte() {
-        if (bitPos != 0) {
-            bitPos = 0;
-            bytePos++;
-        }
-    }
-    
-    size_t getBytePos() const { return bytePos; }
-    void setBytePos(size_t pos) { bytePos = pos; bitPos = 0; }
-};
-
 // ==========================================
 // Renderer
 // ==========================================
@@ -485,83 +441,43 @@ public:
         readFillStyles(br, hasAlpha);
         readLineStyles(br, hasAlpha);
         
-        int numFillBits = br.readBits(4);
-        int numLineBits = br.readBits(4);
+        ShapeRecordDecoder records(br);
+        records.readStyleBits();
         
-        Point currentPos(0, 0);
+        ShapeRecord rec;
         int currentFill0 = 0;
         int currentFill1 = 0;
         int currentLine = 0;
         
-        while(true) {
-            bool typeFlag = br.readBits(1);
-            if (!typeFlag) {
-                uint32_t flags = br.readBits(5);
-                if (flags == 0) break;
-                
-                if (flags & 0x01) {
-                    int nBits = br.readBits(5);
-                    int32_t x = br.readSignedBits(nBits);
-                    int32_t y = br.readSignedBits(nBits);
-                    currentPos.x = x / 20.0;
-                    currentPos.y = y / 20.0;
-                }
-                if (flags & 0x02) currentFill0 = br.readBits(numFillBits);
-                if (flags & 0x04) currentFill1 = br.readBits(numFillBits);
-                if (flags & 0x08) currentLine = br.readBits(numLineBits);
+        while (records.next(rec)) {
+            if (rec.type == ShapeRecord::STYLE_CHANGE) {
+                if (rec.hasFill0) currentFill0 = rec.fill0;
+                if (rec.hasFill1) currentFill1 = rec.fill1;
+                if (rec.hasLine) currentLine = rec.line;
                 
-                if (flags & 0x10) {
+                if (rec.hasNewStyles) {
                     flushLayers();
                     readFillStyles(br, hasAlpha);
                     readLineStyles(br, hasAlpha);
-                    numFillBits = br.readBits(4);
-                    numLineBits = br.readBits(4);
-                }
-            } else {
-                Edge edge;
-                edge.p1 = currentPos;
-                
-                bool straightFlag = br.readBits(1);
-                int numBits = br.readBits(4) + 2;
-                
-                if (straightFlag) {
-                    bool generalLine = br.readBits(1);
-                    int32_t dx = 0, dy = 0;
-                    if (generalLine) {
-                        dx = br.readSignedBits(numBits);
-                        dy = br.readSignedBits(numBits);
-                    } else {
-                        bool vert = br.readBits(1);
-                        if (vert) dy = br.readSignedBits(numBits);
-                        else dx = br.readSignedBits(numBits);
-                    }
-                    edge.p2.x = currentPos.x + dx / 20.0;
-                    edge.p2.y = currentPos.y + dy / 20.0;
-                    edge.isQuad = false;
-                } else {
-                    int32_t cdx = br.readSignedBits(numBits);
-                    int32_t cdy = br.readSignedBits(numBits);
-                    int32_t adx = br.readSignedBits(numBits);
-                    int32_t ady = br.readSignedBits(numBits);
-                    
-                    edge.control.x = currentPos.x + cdx / 20.0;
-                    edge.control.y = currentPos.y + cdy / 20.0;
-                    edge.p2.x = edge.control.x + adx / 20.0;
-                    edge.p2.y = edge.control.y + ady / 20.0;
-                    edge.isQuad = true;
+                    records.readStyleBits();
                 }
-                
-                if (currentFill0 != 0) {
-                    fillLayers[currentFill0].push_back(edge.reversed());
-                }
-                if (currentFill1 != 0) {
-                    fillLayers[currentFill1].push_back(edge);
-                }
-                if (currentLine != 0) {
-                    strokeLayers[currentLine].push_back(edge);
-                }
-                
-                currentPos = edge.p2;
+                continue;
+            }
+            
+            Edge edge;
+            edge.p1 = Point(rec.fromX / 20.0, rec.fromY / 20.0);
+            edge.p2 = Point(rec.x / 20.0, rec.y / 20.0);
+            edge.isQuad = rec.type == ShapeRecord::CURVED_EDGE;
+            if (edge.isQuad) edge.control = Point(rec.controlX / 20.0, rec.controlY / 20.0);
+            
+            if (currentFill0 != 0) {
+                fillLayers[currentFill0].push_back(edge.reversed());
+            }
+            if (currentFill1 != 0) {
+                fillLayers[currentFill1].push_back(edge);
+            }
+            if (currentLine != 0) {
+                strokeLayers[currentLine].push_back(edge);
             }
         }
         
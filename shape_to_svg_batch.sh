@@ -1,6 +1,6 @@
 #!/bin/bash
-for file in output_folder/shape_*_info.txt; do
-    id=$(grep "Shape ID:" "$file" | awk '{print $3}')
-    ver=$(grep "Version:" "$file" | awk '{print $2}')
+grep '"type":"shape"' output_folder/manifest.jsonl | while read -r line; do
+    id=$(echo "$line" | sed 's/.*"id":\([0-9]*\).*/\1/')
+    ver=$(echo "$line" | sed 's/.*"version":\([0-9]*\).*/\1/')
     ./shape_to_svg "output_folder/shape_${id}.dat" "$ver" "output_folder/shape_${id}.svg"
 done
@@ -3,13 +3,41 @@
 #include <vector>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include <cstdint>
 #include <cmath>
 #include <zlib.h>
+#include <lzma.h>
 #include <map>
+#include <set>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <climits>
+#include <cerrno>
+#endif
+
+#include "bit_reader.h"
+#include "shape_records.h"
+#include "swf_pack.h"
+#include "swf_timeline.h"
+#include "unpremultiply.h"
 
 // SWF Tag Types
 enum TagType {
@@ -20,6 +48,7 @@ enum TagType {
     TAG_REMOVE_OBJECT = 5,
     TAG_DEFINE_BITS = 6,
     TAG_DEFINE_BUTTON = 7,
+    TAG_DEFINE_BUTTON2 = 34,
     TAG_JPEG_TABLES = 8,
     TAG_DEFINE_BITS_JPEG2 = 21,
     TAG_DEFINE_BITS_JPEG3 = 35,
@@ -39,349 +68,3687 @@ enum TagType {
     TAG_DEFINE_FONT = 10,
     TAG_DEFINE_FONT2 = 48,
     TAG_DEFINE_FONT3 = 75,
+    TAG_DEFINE_FONT_INFO = 13,
+    TAG_DEFINE_FONT_INFO2 = 62,
     TAG_DEFINE_TEXT = 11,
     TAG_DEFINE_TEXT2 = 33,
     TAG_DEFINE_EDIT_TEXT = 37,
     TAG_DEFINE_SOUND = 14,
+    TAG_SOUND_STREAM_HEAD = 18,
+    TAG_SOUND_STREAM_HEAD2 = 45,
+    TAG_SOUND_STREAM_BLOCK = 19,
     TAG_DEFINE_BINARY_DATA = 87,
     TAG_SYMBOL_CLASS = 76,
     TAG_DEFINE_MORPH_SHAPE = 46,
-    TAG_DEFINE_MORPH_SHAPE2 = 84
+    TAG_DEFINE_MORPH_SHAPE2 = 84,
+    TAG_EXPORT_ASSETS = 56,
+    TAG_DEFINE_VIDEO_STREAM = 60,
+    TAG_VIDEO_FRAME = 61
 };
 
-struct Matrix {
-    double a, b, c, d, tx, ty;
-    Matrix() : a(1), b(0), c(0), d(1), tx(0), ty(0) {}
-};
+// Read-only view of an entire file. On POSIX systems the file is mapped
+// so uncompressed SWFs can be parsed in place without being copied.
+class MappedFile {
+    const uint8_t* base;
+    size_t length;
+#ifdef _WIN32
+    std::vector<uint8_t> buffer;
+#else
+    void* mapping;
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+#ifdef _WIN32
+    MappedFile() : base(nullptr), length(0) {}
+#else
+    MappedFile() : base(nullptr), length(0), mapping(MAP_FAILED) {}
+#endif
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& filename) {
+        close();
+#ifdef _WIN32
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) return false;
+        file.seekg(0, std::ios::end);
+        buffer.resize(file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read((char*)buffer.data(), buffer.size());
+        base = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = st.st_size;
+        if (length > 0) {
+            mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (length > 0 && mapping == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+        if (length > 0) {
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            base = (const uint8_t*)mapping;
+        }
+        return true;
+#endif
+    }
 
-struct ColorTransform {
-    int rMult, gMult, bMult, aMult;
-    int rAdd, gAdd, bAdd, aAdd;
-    ColorTransform() : rMult(256), gMult(256), bMult(256), aMult(256),
-                       rAdd(0), gAdd(0), bAdd(0), aAdd(0) {}
+    void close() {
+#ifdef _WIN32
+        buffer.clear();
+        buffer.shrink_to_fit();
+#else
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, length);
+            mapping = MAP_FAILED;
+        }
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    const uint8_t* data() const { return base; }
+    size_t size() const { return length; }
 };
 
-struct DisplayObject {
-    uint16_t characterId;
-    uint16_t depth;
-    Matrix matrix;
-    ColorTransform colorTransform;
-    std::string name;
+// Produces decompressed bytes on demand. Implementations decode from a
+// compressed buffer a chunk at a time.
+class ChunkSource {
+public:
+    virtual ~ChunkSource() {}
+    // Fills up to cap bytes, returns 0 once the stream is exhausted
+    virtual size_t read(uint8_t* out, size_t cap) = 0;
+    virtual bool failed() const = 0;
 };
 
-class BitReader {
-    const uint8_t* data;
-    size_t bytePos;
-    int bitPos;
-    size_t size;
+class ZlibSource : public ChunkSource {
+    z_stream zs;
+    bool done;
+    bool error;
+
+    ZlibSource(const ZlibSource&) = delete;
+    ZlibSource& operator=(const ZlibSource&) = delete;
 
 public:
-    BitReader(const uint8_t* d, size_t s) : data(d), bytePos(0), bitPos(0), size(s) {}
-    
-    uint32_t readBits(int numBits) {
-        uint32_t result = 0;
-        for (int i = 0; i < numBits; i++) {
-            if (bytePos >= size) return result;
-            int bit = (data[bytePos] >> (7 - bitPos)) & 1;
-            result = (result << 1) | bit;
-            bitPos++;
-            if (bitPos == 8) {
-                bitPos = 0;
-                bytePos++;
-            }
+    ZlibSource(const uint8_t* src, size_t srcSize) : done(false), error(false) {
+        memset(&zs, 0, sizeof(zs));
+        zs.next_in = (Bytef*)src;
+        zs.avail_in = (uInt)std::min<size_t>(srcSize, 0xFFFFFFFFu);
+        if (inflateInit(&zs) != Z_OK) {
+            done = true;
+            error = true;
         }
-        return result;
     }
-    
-    int32_t readSignedBits(int numBits) {
-        uint32_t val = readBits(numBits);
-        if (val & (1 << (numBits - 1))) {
-            return val | (~0u << numBits);
+    ~ZlibSource() override { inflateEnd(&zs); }
+
+    size_t read(uint8_t* out, size_t cap) override {
+        if (done) return 0;
+        zs.next_out = out;
+        zs.avail_out = (uInt)cap;
+        int result = inflate(&zs, Z_NO_FLUSH);
+        size_t produced = cap - zs.avail_out;
+        if (result == Z_STREAM_END) {
+            done = true;
+        } else if (result != Z_OK || (produced == 0 && zs.avail_in == 0)) {
+            // Corrupt or truncated input; keep whatever was produced
+            done = true;
+            error = true;
         }
-        return val;
+        return produced;
     }
-    
-    void alignByte() {
-        if (bitPos != 0) {
-            bitPos = 0;
-            bytePos++;
+
+    bool failed() const override { return error; }
+};
+
+// ZWS bodies are raw LZMA preceded by a 4-byte compressed length and the
+// 5-byte properties block. liblzma's .lzma decoder expects the properties
+// followed by the 8-byte uncompressed size, so that header is synthesized
+// and fed in ahead of the compressed data.
+class LzmaSource : public ChunkSource {
+    lzma_stream strm;
+    uint8_t alone[13];
+    const uint8_t* body;
+    size_t bodySize;
+    bool headerFed;
+    bool done;
+    bool error;
+
+    LzmaSource(const LzmaSource&) = delete;
+    LzmaSource& operator=(const LzmaSource&) = delete;
+
+public:
+    // src points just past the 8-byte SWF header
+    LzmaSource(const uint8_t* src, size_t srcSize, uint64_t uncompressedSize)
+        : strm(LZMA_STREAM_INIT), body(nullptr), bodySize(0), headerFed(false), done(false), error(false) {
+        if (srcSize < 9 || lzma_alone_decoder(&strm, UINT64_MAX) != LZMA_OK) {
+            done = true;
+            error = true;
+            return;
         }
+        memcpy(alone, src + 4, 5);
+        for (int i = 0; i < 8; i++) {
+            alone[5 + i] = (uint8_t)(uncompressedSize >> (8 * i));
+        }
+        body = src + 9;
+        bodySize = srcSize - 9;
+        strm.next_in = alone;
+        strm.avail_in = sizeof(alone);
     }
-    
-    size_t getBytePos() const { return bytePos; }
+    ~LzmaSource() override { lzma_end(&strm); }
+
+    size_t read(uint8_t* out, size_t cap) override {
+        if (done) return 0;
+        strm.next_out = out;
+        strm.avail_out = cap;
+        while (strm.avail_out > 0 && !done) {
+            if (strm.avail_in == 0) {
+                if (headerFed) {
+                    // Input exhausted before the declared size was reached
+                    done = true;
+                    error = true;
+                    break;
+                }
+                headerFed = true;
+                strm.next_in = body;
+                strm.avail_in = bodySize;
+            }
+            lzma_ret result = lzma_code(&strm, LZMA_RUN);
+            if (result == LZMA_STREAM_END) {
+                done = true;
+            } else if (result != LZMA_OK) {
+                done = true;
+                error = true;
+            }
+        }
+        return cap - strm.avail_out;
+    }
+
+    bool failed() const override { return error; }
 };
 
-class SWFExtractor {
-    std::vector<uint8_t> data;
-    std::string outputDir;
-    int currentFrame;
-    int globalFrame;
-    std::map<int, std::string> characterMap;
-    std::map<int, std::string> characterTypes;
-    std::map<uint16_t, DisplayObject> displayList;
-    std::vector<uint8_t> jpegTables;
-    
-    void createDirectory(const std::string& path) {
-        #ifdef _WIN32
-        _mkdir(path.c_str());
-        #else
-        mkdir(path.c_str(), 0755);
-        #endif
+// Sliding window over a ChunkSource. Bytes are pulled in only as needed
+// and discarded once consumed, so memory is bounded by the largest
+// single request rather than by the stream length.
+class StreamWindow {
+    ChunkSource& source;
+    std::vector<uint8_t> buffer;
+    size_t start;
+    size_t end;
+    bool exhausted;
+    uint64_t consumedTotal;
+
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+public:
+    StreamWindow(ChunkSource& src) : source(src), start(0), end(0), exhausted(false), consumedTotal(0) {}
+
+    // Makes at least need bytes available, returns false if the stream
+    // ended first (available() then reports what is left)
+    bool fill(size_t need) {
+        while (end - start < need && !exhausted) {
+            if (start > 0 && (start >= buffer.size() / 2 || buffer.size() - end < CHUNK_SIZE)) {
+                memmove(buffer.data(), buffer.data() + start, end - start);
+                end -= start;
+                start = 0;
+            }
+            size_t want = std::max(CHUNK_SIZE, need - (end - start));
+            if (buffer.size() - end < want) {
+                buffer.resize(end + want);
+            }
+            size_t got = source.read(buffer.data() + end, buffer.size() - end);
+            if (got == 0) exhausted = true;
+            end += got;
+        }
+        return end - start >= need;
     }
-    
-    uint32_t readU32(size_t& pos) {
-        if (pos + 4 > data.size()) return 0;
-        uint32_t val = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | (data[pos+3] << 24);
-        pos += 4;
-        return val;
+
+    void consume(size_t n) {
+        n = std::min(n, end - start);
+        start += n;
+        consumedTotal += n;
     }
-    
-    uint16_t readU16(size_t& pos) {
-        if (pos + 2 > data.size()) return 0;
-        uint16_t val = data[pos] | (data[pos+1] << 8);
-        pos += 2;
-        return val;
+
+    // Discards n bytes a chunk at a time, so skipping a large tag never
+    // grows the buffer; returns false if the stream ended first
+    bool skip(size_t n) {
+        while (n > 0) {
+            if (start == end && !fill(1)) return false;
+            size_t step = std::min(n, end - start);
+            consume(step);
+            n -= step;
+        }
+        return true;
     }
-    
-    uint8_t readU8(size_t& pos) {
-        if (pos >= data.size()) return 0;
-        return data[pos++];
+
+    const uint8_t* current() const { return buffer.data() + start; }
+    size_t available() const { return end - start; }
+    uint64_t offset() const { return consumedTotal; }
+    size_t capacity() const { return buffer.size(); }
+    bool failed() const { return source.failed(); }
+};
+
+// Fixed set of worker threads, each owning a task deque. A worker runs
+// its own newest task first and steals the oldest task from a sibling
+// when its deque is empty, so bursts of small jobs spread across cores.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+
+    static thread_local WorkStealingPool* currentPool;
+    static thread_local unsigned currentIndex;
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    bool tryPop(unsigned self, Task& task) {
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                pending--;
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                pending--;
+                return true;
+            }
+        }
+        return false;
     }
-    
-    std::string readString(size_t& pos) {
-        std::string result;
-        while (pos < data.size() && data[pos] != 0) {
-            result += (char)data[pos++];
+
+    void workerLoop(unsigned index) {
+        currentPool = this;
+        currentIndex = index;
+        while (true) {
+            Task task;
+            if (tryPop(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping && pending == 0) return;
         }
-        if (pos < data.size()) pos++;
-        return result;
     }
-    
-    Matrix readMatrix(BitReader& br) {
-        Matrix m;
-        bool hasScale = br.readBits(1);
-        if (hasScale) {
-            int nScaleBits = br.readBits(5);
-            m.a = br.readSignedBits(nScaleBits) / 65536.0;
-            m.d = br.readSignedBits(nScaleBits) / 65536.0;
+
+public:
+    explicit WorkStealingPool(unsigned threads) : pending(0), nextQueue(0), stopping(false) {
+        if (threads == 0) threads = 1;
+        for (unsigned i = 0; i < threads; i++) {
+            queues.emplace_back(new Queue());
         }
-        bool hasRotate = br.readBits(1);
-        if (hasRotate) {
-            int nRotateBits = br.readBits(5);
-            m.c = br.readSignedBits(nRotateBits) / 65536.0;
-            m.b = br.readSignedBits(nRotateBits) / 65536.0;
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
         }
-        int nTranslateBits = br.readBits(5);
-        m.tx = br.readSignedBits(nTranslateBits) / 20.0;
-        m.ty = br.readSignedBits(nTranslateBits) / 20.0;
-        return m;
     }
-    
-    ColorTransform readColorTransform(BitReader& br, bool hasAlpha) {
-        ColorTransform ct;
-        bool hasAdd = br.readBits(1);
-        bool hasMult = br.readBits(1);
-        int nBits = br.readBits(4);
-        
-        if (hasMult) {
-            ct.rMult = br.readSignedBits(nBits);
-            ct.gMult = br.readSignedBits(nBits);
-            ct.bMult = br.readSignedBits(nBits);
-            if (hasAlpha) ct.aMult = br.readSignedBits(nBits);
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
         }
-        if (hasAdd) {
-            ct.rAdd = br.readSignedBits(nBits);
-            ct.gAdd = br.readSignedBits(nBits);
-            ct.bAdd = br.readSignedBits(nBits);
-            if (hasAlpha) ct.aAdd = br.readSignedBits(nBits);
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
         }
-        return ct;
     }
-    
-    void extractShape(size_t tagStart, size_t tagLength, int characterId, int shapeVersion) {
-        std::stringstream filename;
-        filename << outputDir << "/shape_" << characterId << ".dat";
-        
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open() && tagStart + tagLength <= data.size()) {
-            out.write((const char*)&data[tagStart], tagLength);
-            out.close();
-            
-            std::stringstream infofile;
-            infofile << outputDir << "/shape_" << characterId << "_info.txt";
-            std::ofstream info(infofile.str());
-            info << "Shape ID: " << characterId << "\n";
-            info << "Version: " << shapeVersion << "\n";
-            info << "Data size: " << tagLength << " bytes\n";
-            info.close();
-            
-            std::cout << "Extracted shape: " << filename.str() << " (ID: " << characterId << ", v" << shapeVersion << ")" << std::endl;
-            characterMap[characterId] = filename.str();
-            characterTypes[characterId] = "shape";
+
+    void submit(Task task) {
+        // Tasks spawned by a worker stay on its own deque
+        unsigned index = (currentPool == this) ? currentIndex : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            pending++;
         }
+        wake.notify_one();
     }
-    
-    void extractJPEG(const uint8_t* imgData, size_t imgSize, int characterId, bool hasTables) {
-        std::stringstream filename;
-        filename << outputDir << "/image_" << characterId << ".jpg";
-        
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open()) {
-            if (hasTables && jpegTables.size() > 0 && imgSize > 2 && !(imgData[0] == 0xFF && imgData[1] == 0xD8)) {
-                size_t tableSize = jpegTables.size();
-                if (tableSize >= 2 && jpegTables[tableSize-2] == 0xFF && jpegTables[tableSize-1] == 0xD9) {
-                    out.write((const char*)jpegTables.data(), tableSize - 2);
-                } else {
-                    out.write((const char*)jpegTables.data(), tableSize);
-                }
-                if (imgData[0] == 0xFF && imgData[1] == 0xD8) {
-                    out.write((const char*)(imgData + 2), imgSize - 2);
-                } else {
-                    out.write((const char*)imgData, imgSize);
+
+    // Runs one queued task on the calling thread, returns false if none
+    // was available. Lets a thread that is waiting on results help out.
+    bool runPending() {
+        Task task;
+        unsigned start = (currentPool == this) ? currentIndex : nextQueue % queues.size();
+        if (!tryPop(start, task)) return false;
+        task();
+        return true;
+    }
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Pool the calling thread works for, or null outside any pool
+    static WorkStealingPool* current() { return currentPool; }
+};
+
+thread_local WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local unsigned WorkStealingPool::currentIndex = 0;
+
+// A batch of tasks that can be waited on as a unit. The waiting thread
+// runs queued work instead of blocking, so groups may be nested.
+class TaskGroup {
+    WorkStealingPool& pool;
+    std::atomic<size_t> outstanding;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+public:
+    TaskGroup(WorkStealingPool& p) : pool(p), outstanding(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(std::function<void()> fn) {
+        outstanding++;
+        pool.submit([this, fn]() {
+            try {
+                fn();
+            } catch (const std::exception& e) {
+                std::cerr << "Task failed: " << e.what() << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--outstanding == 0) finished.notify_all();
+        });
+    }
+
+    void wait() {
+        while (outstanding > 0) {
+            if (pool.runPending()) continue;
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait_for(lock, std::chrono::milliseconds(1), [this] { return outstanding == 0; });
+        }
+        // The last task may still hold the mutex; let it finish with it
+        // before the group can be destroyed
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+};
+
+// Admission control for batch mode: a byte budget and a cap on jobs in
+// flight. A job that does not fit waits for others to release; one larger
+// than the whole budget still runs once nothing else holds any.
+class MemoryBudget {
+    uint64_t limit;
+    uint64_t used;
+    unsigned maxActive;
+    unsigned active;
+    std::mutex mutex;
+    std::condition_variable released;
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+public:
+    MemoryBudget(uint64_t bytes, unsigned slots) : limit(bytes), used(0), maxActive(std::max(1u, slots)), active(0) {}
+
+    // Blocks until one of the costs fits, reserves it and returns its
+    // index. Earlier entries win, so callers order by preference.
+    size_t acquireFirstFit(const std::vector<uint64_t>& costs) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (active < maxActive) {
+                for (size_t i = 0; i < costs.size(); i++) {
+                    if (used == 0 || used + costs[i] <= limit) {
+                        used += costs[i];
+                        active++;
+                        return i;
+                    }
                 }
-            } else {
-                out.write((const char*)imgData, imgSize);
             }
-            out.close();
-            std::cout << "Extracted JPEG: " << filename.str() << " (ID: " << characterId << ")" << std::endl;
-            characterMap[characterId] = filename.str();
-            characterTypes[characterId] = "image";
+            released.wait(lock);
         }
     }
-    
-    void extractPNG(const uint8_t* imgData, size_t width, size_t height, int format, int characterId, bool hasAlpha) {
-        std::stringstream filename;
-        filename << outputDir << "/image_" << characterId << ".raw";
-        
-        int bpp = hasAlpha ? 4 : 3;
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open()) {
-            out.write((const char*)imgData, width * height * bpp);
-            out.close();
-            
-            std::stringstream info;
-            info << outputDir << "/image_" << characterId << "_info.txt";
-            std::ofstream infoFile(info.str());
-            infoFile << "Width: " << width << "\n";
-            infoFile << "Height: " << height << "\n";
-            infoFile << "BPP: " << bpp << "\n";
-            infoFile << "Format: " << (hasAlpha ? "RGBA" : "RGB") << "\n";
-            infoFile.close();
-            
-            std::cout << "Extracted bitmap: " << filename.str() << " (" << width << "x" << height << ")" << std::endl;
-            characterMap[characterId] = filename.str();
-            characterTypes[characterId] = "image";
+
+    void release(uint64_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            used -= bytes;
+            active--;
         }
+        released.notify_all();
     }
-    
-    void extractBinaryData(const uint8_t* binData, size_t binSize, int characterId) {
-        std::stringstream filename;
-        filename << outputDir << "/binary_" << characterId << ".bin";
-        
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open()) {
-            out.write((const char*)binData, binSize);
-            out.close();
-            std::cout << "Extracted binary data: " << filename.str() << " (" << binSize << " bytes)" << std::endl;
-            characterMap[characterId] = filename.str();
-            characterTypes[characterId] = "binary";
+};
+
+// Encodes 8-bit PNGs. The image is split into bands of rows that are
+// filtered and deflated independently, pigz-style: each band is a raw
+// deflate stream ending on a byte boundary (Z_SYNC_FLUSH) and primed with
+// the last 32 KiB of the band before it, so the bands concatenate into a
+// single zlib stream while compressing almost as well as one deflate call.
+// When called from a pool worker the bands run as pool tasks.
+class PngEncoder {
+public:
+    enum ColorType {
+        PNG_GRAY = 0,
+        PNG_RGB = 2,
+        PNG_PALETTE = 3,
+        PNG_RGBA = 6
+    };
+
+private:
+    static const size_t BAND_BYTES = 128 * 1024;
+    static const size_t WINDOW_BYTES = 32 * 1024;
+
+    static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+        out.push_back(v >> 24);
+        out.push_back((v >> 16) & 0xFF);
+        out.push_back((v >> 8) & 0xFF);
+        out.push_back(v & 0xFF);
+    }
+
+    static void putChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* body, size_t size) {
+        putU32(out, (uint32_t)size);
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), body, body + size);
+        putU32(out, (uint32_t)crc32(0, &out[start], (uInt)(out.size() - start)));
+    }
+
+    // Signature and IHDR for an 8-bit image
+    static std::vector<uint8_t> header(uint32_t width, uint32_t height, ColorType colorType) {
+        std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        std::vector<uint8_t> ihdr;
+        putU32(ihdr, width);
+        putU32(ihdr, height);
+        ihdr.push_back(8);
+        ihdr.push_back((uint8_t)colorType);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        ihdr.push_back(0);
+        putChunk(png, "IHDR", ihdr.data(), ihdr.size());
+        return png;
+    }
+
+    static int paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return a;
+        return pb <= pc ? b : c;
+    }
+
+    // Writes filter byte + filtered row to out. Palette images use no
+    // filter; truecolor rows take whichever filter gives the smallest sum
+    // of absolute values, the usual libpng heuristic.
+    static void filterRow(const uint8_t* row, const uint8_t* prev, size_t rowBytes, int bpp,
+                          bool palette, uint8_t* out, std::vector<uint8_t>& scratch) {
+        if (palette) {
+            out[0] = 0;
+            memcpy(out + 1, row, rowBytes);
+            return;
+        }
+        scratch.resize(5 * rowBytes);
+        uint64_t best = UINT64_MAX;
+        int bestFilter = 0;
+        for (int f = 0; f < 5; f++) {
+            uint8_t* dst = &scratch[f * rowBytes];
+            uint64_t sum = 0;
+            for (size_t i = 0; i < rowBytes; i++) {
+                int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+                int b = prev ? prev[i] : 0;
+                int c = (prev && i >= (size_t)bpp) ? prev[i - bpp] : 0;
+                int pred = f == 0 ? 0 : f == 1 ? a : f == 2 ? b : f == 3 ? (a + b) / 2 : paeth(a, b, c);
+                dst[i] = (uint8_t)(row[i] - pred);
+                sum += dst[i] < 128 ? dst[i] : 256 - dst[i];
+            }
+            if (sum < best) {
+                best = sum;
+                bestFilter = f;
+            }
         }
+        out[0] = (uint8_t)bestFilter;
+        memcpy(out + 1, &scratch[bestFilter * rowBytes], rowBytes);
     }
-    
-    void extractSound(const uint8_t* soundData, size_t soundSize, int characterId, int format) {
-        std::stringstream filename;
-        const char* ext = ".raw";
-        if (format == 2) ext = ".mp3";
-        else if (format == 3) ext = ".raw";
-        
-        filename << outputDir << "/sound_" << characterId << ext;
-        
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open()) {
-            out.write((const char*)soundData, soundSize);
-            out.close();
-            std::cout << "Extracted sound: " << filename.str() << " (format=" << format << ")" << std::endl;
-            characterMap[characterId] = filename.str();
-            characterTypes[characterId] = "sound";
+
+    static bool deflateBand(const uint8_t* dict, size_t dictSize, const uint8_t* in, size_t size,
+                            bool last, std::vector<uint8_t>& out) {
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
         }
+        if (dictSize > 0) deflateSetDictionary(&strm, dict, (uInt)dictSize);
+        out.resize(deflateBound(&strm, size) + 16);
+        strm.next_in = (Bytef*)in;
+        strm.avail_in = (uInt)size;
+        strm.next_out = out.data();
+        strm.avail_out = (uInt)out.size();
+        int result = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool ok = last ? result == Z_STREAM_END : (result == Z_OK && strm.avail_in == 0);
+        out.resize(strm.total_out);
+        deflateEnd(&strm);
+        return ok;
     }
-    
-    void extractActionScript(const uint8_t* scriptData, size_t scriptSize, int frameNum, int scriptNum, const std::string& context = "") {
-        std::stringstream filename;
-        if (context.empty()) {
-            filename << outputDir << "/frame_" << std::setw(4) << std::setfill('0') << frameNum 
-                     << "_action_" << scriptNum << ".as";
+
+public:
+    // pixels holds height rows of width * channels bytes (one index byte
+    // per pixel for palette images). palette is RGB triples; alphas, if
+    // not empty, becomes the tRNS chunk. Returns an empty vector on failure.
+    static std::vector<uint8_t> encode(const uint8_t* pixels, uint32_t width, uint32_t height, ColorType colorType,
+                                       const std::vector<uint8_t>& palette = std::vector<uint8_t>(),
+                                       const std::vector<uint8_t>& alphas = std::vector<uint8_t>()) {
+        int bpp = colorType == PNG_RGBA ? 4 : colorType == PNG_RGB ? 3 : 1;
+        size_t rowBytes = (size_t)width * bpp;
+        size_t lineBytes = rowBytes + 1;
+        size_t rowsPerBand = std::max<size_t>(1, BAND_BYTES / lineBytes);
+        size_t bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+
+        std::vector<uint8_t> filtered(lineBytes * height);
+        std::vector<std::vector<uint8_t>> bands(bandCount);
+        std::vector<uLong> adlers(bandCount);
+        std::atomic<bool> failed(false);
+
+        auto filterBand = [&](size_t band) {
+            std::vector<uint8_t> scratch;
+            size_t end = std::min<size_t>(height, (band + 1) * rowsPerBand);
+            for (size_t y = band * rowsPerBand; y < end; y++) {
+                filterRow(pixels + y * rowBytes, y > 0 ? pixels + (y - 1) * rowBytes : nullptr,
+                          rowBytes, bpp, colorType == PNG_PALETTE, &filtered[y * lineBytes], scratch);
+            }
+        };
+        auto deflateBandAt = [&](size_t band) {
+            size_t start = band * rowsPerBand * lineBytes;
+            size_t end = std::min<size_t>(height, (band + 1) * rowsPerBand) * lineBytes;
+            size_t dictSize = std::min(start, WINDOW_BYTES);
+            adlers[band] = adler32(1, &filtered[start], (uInt)(end - start));
+            if (!deflateBand(&filtered[start - dictSize], dictSize, &filtered[start], end - start,
+                             band + 1 == bandCount, bands[band])) {
+                failed = true;
+            }
+        };
+
+        WorkStealingPool* pool = WorkStealingPool::current();
+        if (pool && bandCount > 1) {
+            // Every band has to be filtered before any can be deflated,
+            // since each one's dictionary is the end of the previous band
+            {
+                TaskGroup group(*pool);
+                for (size_t b = 0; b < bandCount; b++) group.run([&filterBand, b]() { filterBand(b); });
+            }
+            TaskGroup group(*pool);
+            for (size_t b = 0; b < bandCount; b++) group.run([&deflateBandAt, b]() { deflateBandAt(b); });
+            group.wait();
         } else {
-            filename << outputDir << "/" << context << "_action_" << scriptNum << ".as";
+            for (size_t b = 0; b < bandCount; b++) filterBand(b);
+            for (size_t b = 0; b < bandCount; b++) deflateBandAt(b);
         }
-        
-        std::ofstream out(filename.str(), std::ios::binary);
-        if (out.is_open()) {
-            out.write((const char*)scriptData, scriptSize);
-            out.close();
-            
-            std::stringstream hexfile;
-            hexfile << filename.str() << ".hex";
-            std::ofstream hexout(hexfile.str());
-            for (size_t i = 0; i < scriptSize; i++) {
-                hexout << std::hex << std::setw(2) << std::setfill('0') << (int)scriptData[i] << " ";
-                if ((i + 1) % 16 == 0) hexout << "\n";
-            }
-            hexout.close();
-            
-            std::cout << "Extracted ActionScript: " << filename.str() << " (" << scriptSize << " bytes)" << std::endl;
+        if (failed) return std::vector<uint8_t>();
+
+        std::vector<uint8_t> png = header(width, height, colorType);
+        if (colorType == PNG_PALETTE) {
+            putChunk(png, "PLTE", palette.data(), palette.size());
+            if (!alphas.empty()) putChunk(png, "tRNS", alphas.data(), alphas.size());
         }
-    }
-    
-    void saveFrameState(int frameNum) {
-        std::stringstream filename;
-        filename << outputDir << "/frame_" << std::setw(4) << std::setfill('0') << frameNum << "_display.txt";
-        
-        std::ofstream out(filename.str());
-        if (out.is_open()) {
-            out << "=== FRAME " << frameNum << " DISPLAY LIST ===" << "\n\n";
-            
-            for (auto& pair : displayList) {
-                DisplayObject& obj = pair.second;
-                out << "Depth: " << obj.depth << "\n";
-                out << "  Character ID: " << obj.characterId << "\n";
-                
-                if (characterTypes.count(obj.characterId)) {
-                    out << "  Type: " << characterTypes[obj.characterId] << "\n";
-                }
-                if (characterMap.count(obj.characterId)) {
-                    out << "  File: " << characterMap[obj.characterId] << "\n";
-                }
-                
-                out << "  Matrix: [" << obj.matrix.a << ", " << obj.matrix.b << ", "
-                    << obj.matrix.c << ", " << obj.matrix.d << ", "
-                    << obj.matrix.tx << ", " << obj.matrix.ty << "]\n";
-                
-                if (!obj.name.empty()) {
-                    out << "  Name: " << obj.name << "\n";
-                }
-                out << "\n";
+
+        // One IDAT per band; together they hold a single zlib stream
+        uLong adler = adlers.empty() ? 1 : adlers[0];
+        for (size_t b = 1; b < bandCount; b++) {
+            size_t length = (std::min<size_t>(height, (b + 1) * rowsPerBand) - b * rowsPerBand) * lineBytes;
+            adler = adler32_combine(adler, adlers[b], (z_off_t)length);
+        }
+        for (size_t b = 0; b < bandCount; b++) {
+            std::vector<uint8_t>& body = bands[b];
+            if (b == 0) body.insert(body.begin(), {0x78, 0x9C});
+            if (b + 1 == bandCount) {
+                body.push_back(adler >> 24);
+                body.push_back((adler >> 16) & 0xFF);
+                body.push_back((adler >> 8) & 0xFF);
+                body.push_back(adler & 0xFF);
             }
-            out.close();
-            std::cout << "Saved frame state: " << filename.str() << " (" << displayList.size() << " objects)" << std::endl;
+            putChunk(png, "IDAT", body.data(), body.size());
+            std::vector<uint8_t>().swap(body);
         }
+        putChunk(png, "IEND", nullptr, 0);
+        return png;
     }
-    
-    void processSprite(uint16_t spriteId, size_t& pos, size_t endPos) {
-        std::cout << "Processing sprite " << spriteId << " contents..." << std::endl;
-        int spriteFrame = 0;
-        int actionCount = 0;
+
+    // Encodes a truecolor or grayscale image one row at a time with a
+    // single deflate stream, for callers that produce rows incrementally
+    // and cannot hold the whole image. Only the previous row and the
+    // compressed output are kept.
+    class RowWriter {
+        std::vector<uint8_t> png;
+        std::vector<uint8_t> prev, line, scratch, idat;
+        z_stream strm;
+        size_t rowBytes;
+        int bpp;
+        uint32_t rowsLeft;
+        bool ok;
+
+        RowWriter(const RowWriter&) = delete;
+        RowWriter& operator=(const RowWriter&) = delete;
+
+        void drain(int flush) {
+            do {
+                strm.next_out = idat.data();
+                strm.avail_out = (uInt)idat.size();
+                int result = deflate(&strm, flush);
+                if (result == Z_STREAM_ERROR) ok = false;
+                size_t produced = idat.size() - strm.avail_out;
+                if (produced > 0) putChunk(png, "IDAT", idat.data(), produced);
+            } while (strm.avail_out == 0);
+        }
+
+    public:
+        RowWriter(uint32_t width, uint32_t height, ColorType colorType)
+            : png(header(width, height, colorType)), idat(64 * 1024), rowsLeft(height), ok(true) {
+            bpp = colorType == PNG_RGBA ? 4 : colorType == PNG_RGB ? 3 : 1;
+            rowBytes = (size_t)width * bpp;
+            line.resize(rowBytes + 1);
+            memset(&strm, 0, sizeof(strm));
+            if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) ok = false;
+        }
+
+        ~RowWriter() { deflateEnd(&strm); }
+
+        void addRow(const uint8_t* row) {
+            if (!ok || rowsLeft == 0) return;
+            filterRow(row, prev.empty() ? nullptr : prev.data(), rowBytes, bpp, false, line.data(), scratch);
+            prev.assign(row, row + rowBytes);
+            strm.next_in = line.data();
+            strm.avail_in = (uInt)line.size();
+            drain(Z_NO_FLUSH);
+            rowsLeft--;
+        }
+
+        // Returns the finished file, or an empty vector if rows are
+        // missing or compression failed
+        std::vector<uint8_t> finish() {
+            if (!ok || rowsLeft != 0) return std::vector<uint8_t>();
+            strm.avail_in = 0;
+            drain(Z_FINISH);
+            putChunk(png, "IEND", nullptr, 0);
+            return std::move(png);
+        }
+    };
+};
+
+// XXH64 (https://github.com/Cyan4973/xxHash), used as the content hash
+// for the asset store. Runs at memory speed on four independent lanes.
+static uint64_t xxh64(const uint8_t* p, size_t len, uint64_t seed) {
+    const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL, P3 = 1609587929392839161ULL,
+                   P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const uint8_t* q) { uint64_t v; memcpy(&v, q, 8); return v; };
+    auto read32 = [](const uint8_t* q) { uint32_t v; memcpy(&v, q, 4); return (uint64_t)v; };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+    auto merge = [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * P1 + P4; };
+
+    const uint8_t* end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += (uint64_t)len;
+    for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) h = rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Reads the frame size from a JPEG's SOF marker
+static bool jpegDimensions(const uint8_t* p, size_t size, uint32_t& width, uint32_t& height) {
+    size_t pos = 0;
+    while (pos + 4 <= size) {
+        if (p[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+        uint8_t marker = p[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        // Markers without a length: SOI, EOI, RSTn, TEM
+        if (marker == 0xD8 || marker == 0xD9 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01 || marker == 0x00) {
+            pos += 2;
+            continue;
+        }
+        size_t length = (p[pos + 2] << 8) | p[pos + 3];
+        bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (startOfFrame && pos + 9 <= size) {
+            height = (p[pos + 5] << 8) | p[pos + 6];
+            width = (p[pos + 7] << 8) | p[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+// ==========================================
+// Sound
+// ==========================================
+
+// Sample rates of the 2-bit rate field in sound headers
+static const uint32_t SOUND_RATES[4] = {5512, 11025, 22050, 44100};
+
+// 44-byte RIFF header of a PCM WAV file holding dataSize bytes of samples
+static std::vector<uint8_t> wavHeader(uint32_t rate, int channels, int bits, uint32_t dataSize) {
+    std::vector<uint8_t> h;
+    auto put = [&h](uint32_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) h.push_back((uint8_t)(v >> (8 * i)));
+    };
+    uint32_t blockAlign = channels * bits / 8;
+    h.insert(h.end(), {'R', 'I', 'F', 'F'});
+    put(36 + dataSize, 4);
+    h.insert(h.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put(16, 4);
+    put(1, 2);                       // PCM
+    put(channels, 2);
+    put(rate, 4);
+    put(rate * blockAlign, 4);
+    put(blockAlign, 2);
+    put(bits, 2);
+    h.insert(h.end(), {'d', 'a', 't', 'a'});
+    put(dataSize, 4);
+    return h;
+}
+
+// Decodes one block of SWF ADPCM (a 2-bit code size, then packets of an
+// initial sample and step index per channel followed by up to 4095
+// interleaved codes) and appends it as 16-bit little-endian PCM. This is
+// IMA ADPCM with 2 to 5 bit codes and its own bit packing.
+static void decodeAdpcm(const uint8_t* p, size_t size, int channels, std::vector<uint8_t>& pcm) {
+    static const int steps[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+        73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408,
+        449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+        9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+    static const int indexShifts[4][16] = {
+        {-1, 2},
+        {-1, -1, 2, 4},
+        {-1, -1, -1, -1, 2, 4, 6, 8},
+        {-1, -1, -1, -1, -1, -1, -1, -1, 1, 2, 4, 6, 8, 10, 13, 16}
+    };
+    auto put = [&pcm](int sample) {
+        pcm.push_back((uint8_t)(sample & 0xFF));
+        pcm.push_back((uint8_t)((sample >> 8) & 0xFF));
+    };
+    
+    BitReader br(p, size);
+    uint64_t totalBits = (uint64_t)size * 8;
+    int codeBits = br.readBits(2) + 2;
+    const int* shifts = indexShifts[codeBits - 2];
+    int signBit = 1 << (codeBits - 1);
+    int predictor[2] = {0, 0};
+    int index[2] = {0, 0};
+    uint64_t used = 2;
+    
+    while (used + 22 * channels <= totalBits) {
+        for (int c = 0; c < channels; c++) {
+            predictor[c] = br.readSignedBits(16);
+            index[c] = br.readBits(6);
+            put(predictor[c]);
+        }
+        used += 22 * channels;
+        for (int n = 0; n < 4095 && used + codeBits * channels <= totalBits; n++) {
+            for (int c = 0; c < channels; c++) {
+                int code = br.readBits(codeBits);
+                int step = steps[index[c]];
+                int diff = 0;
+                for (int bit = signBit >> 1; bit; bit >>= 1, step >>= 1) {
+                    if (code & bit) diff += step;
+                }
+                diff += step;
+                predictor[c] += (code & signBit) ? -diff : diff;
+                predictor[c] = std::max(-32768, std::min(32767, predictor[c]));
+                index[c] = std::max(0, std::min(88, index[c] + shifts[code & (signBit - 1)]));
+                put(predictor[c]);
+            }
+            used += codeBits * channels;
+        }
+    }
+}
+
+// ==========================================
+// Video
+// ==========================================
+
+// VideoFrame codecs, numbered the same in DefineVideoStream and FLV
+enum VideoCodec {
+    VIDEO_H263 = 2,                 // Sorenson H.263
+    VIDEO_SCREEN = 3,
+    VIDEO_VP6 = 4,
+    VIDEO_VP6_ALPHA = 5,
+    VIDEO_SCREEN2 = 6
+};
+
+// FLV frame type of a VideoFrame payload, read from the codec's own
+// picture header: 1 for a keyframe, 2 for an inter frame, 3 for a
+// disposable inter frame. Unknown codecs count every frame as a keyframe.
+static int videoFrameType(int codec, const uint8_t* p, size_t size) {
+    switch (codec) {
+        case VIDEO_H263: {
+            // Start code, version, temporal reference, size, then picture type
+            BitReader br(p, size);
+            br.readBits(17);
+            br.readBits(5);
+            br.readBits(8);
+            int pictureSize = br.readBits(3);
+            if (pictureSize == 0) br.readBits(16);
+            else if (pictureSize == 1) br.readBits(32);
+            int pictureType = br.readBits(2);
+            return br.overran() ? 1 : pictureType + 1;
+        }
+        case VIDEO_VP6:
+            return (size > 0 && (p[0] & 0x80)) ? 2 : 1;
+        case VIDEO_VP6_ALPHA:
+            // OffsetToAlpha comes first
+            return (size > 3 && (p[3] & 0x80)) ? 2 : 1;
+        case VIDEO_SCREEN: {
+            // A keyframe updates every block; unchanged blocks have size 0
+            BitReader br(p, size);
+            int blockWidth = (br.readBits(4) + 1) * 16;
+            int imageWidth = br.readBits(12);
+            int blockHeight = (br.readBits(4) + 1) * 16;
+            int imageHeight = br.readBits(12);
+            size_t blocks = (size_t)((imageWidth + blockWidth - 1) / blockWidth)
+                          * ((imageHeight + blockHeight - 1) / blockHeight);
+            size_t pos = 4;
+            for (size_t i = 0; i < blocks; i++) {
+                if (pos + 2 > size) return 2;
+                size_t blockSize = (p[pos] << 8) | p[pos + 1];
+                if (blockSize == 0) return 2;
+                pos += 2 + blockSize;
+            }
+            return 1;
+        }
+        default:
+            return 1;
+    }
+}
+
+// ==========================================
+// Fonts
+// ==========================================
+
+// SVG path data for one glyph SHAPE, with y flipped so that it can go
+// straight into an SVG font's y-up em square. Glyphs use a single fill
+// style, so every edge belongs to the outline.
+static std::string glyphPath(const uint8_t* p, size_t size) {
+    BitReader br(p, size);
+    ShapeRecordDecoder records(br);
+    records.readStyleBits();
+    ShapeRecord rec;
+    std::string d;
+    char buf[64];
+    bool open = false;
+    while (records.next(rec)) {
+        if (rec.type == ShapeRecord::STYLE_CHANGE) {
+            if (rec.hasMove) open = false;
+            continue;
+        }
+        if (!open) {
+            snprintf(buf, sizeof(buf), "M%d %d", rec.fromX, -rec.fromY);
+            d += buf;
+            open = true;
+        }
+        if (rec.type == ShapeRecord::STRAIGHT_EDGE) {
+            snprintf(buf, sizeof(buf), "L%d %d", rec.x, -rec.y);
+        } else {
+            snprintf(buf, sizeof(buf), "Q%d %d %d %d", rec.controlX, -rec.controlY, rec.x, -rec.y);
+        }
+        d += buf;
+    }
+    return d;
+}
+
+// Decodes every glyph of a font's shape table. offsets has one entry per
+// glyph plus the end of the table. Large fonts (CJK fonts carry tens of
+// thousands of glyphs) are split into ranges decoded on the pool.
+static void decodeGlyphs(const uint8_t* table, const std::vector<uint32_t>& offsets,
+                         std::vector<std::string>& paths) {
+    const size_t GLYPHS_PER_RANGE = 256;
+    size_t count = offsets.size() - 1;
+    paths.assign(count, std::string());
+    auto decodeRange = [&](size_t first) {
+        size_t last = std::min(count, first + GLYPHS_PER_RANGE);
+        for (size_t g = first; g < last; g++) {
+            if (offsets[g] < offsets[g + 1]) paths[g] = glyphPath(table + offsets[g], offsets[g + 1] - offsets[g]);
+        }
+    };
+    
+    WorkStealingPool* pool = WorkStealingPool::current();
+    if (pool && count > GLYPHS_PER_RANGE) {
+        TaskGroup group(*pool);
+        for (size_t g = 0; g < count; g += GLYPHS_PER_RANGE) group.run([&decodeRange, g]() { decodeRange(g); });
+        group.wait();
+    } else {
+        for (size_t g = 0; g < count; g += GLYPHS_PER_RANGE) decodeRange(g);
+    }
+}
+
+// Header, glyph offsets and code table of a DefineFont, DefineFont2 or
+// DefineFont3. DefineFont has no codes; its DefineFontInfo supplies them.
+struct FontTables {
+    uint16_t characterId;
+    uint32_t flags;                 // DefineFont2/3 flags byte
+    bool wideCodes;
+    std::string name;
+    size_t numGlyphs;
+    size_t tableStart;              // Offsets are relative to the offset table
+    std::vector<uint32_t> offsets;  // One per glyph, then the end of the last one
+    std::vector<uint16_t> codes;    // Character code of each glyph
+    size_t layoutStart;             // Ascent, descent, advances... when flags & 0x80
+    bool truncated;                 // The code table is cut short
+
+    FontTables() : characterId(0), flags(0), wideCodes(false), numGlyphs(0), tableStart(0),
+                   layoutStart(0), truncated(false) {}
+};
+
+// False when the offset table is unusable
+static bool readFontTables(const uint8_t* payload, size_t size, uint16_t tagType, FontTables& font) {
+    if (size < 4) return false;
+    BitReader br(payload, size);
+    auto u8 = [&br]() { br.alignByte(); return br.readBits(8); };
+    auto u16 = [&u8]() { uint32_t lo = u8(); return lo | (u8() << 8); };
+    
+    font.characterId = u16();
+    bool wideOffsets = false;
+    if (tagType == TAG_DEFINE_FONT) {
+        // The first offset also tells how long the offset table is
+        font.numGlyphs = (payload[2] | (payload[3] << 8)) / 2;
+    } else {
+        font.flags = u8();
+        wideOffsets = font.flags & 0x08;
+        font.wideCodes = (font.flags & 0x04) || tagType == TAG_DEFINE_FONT3;
+        u8();                           // Language code
+        uint32_t nameLength = u8();
+        for (uint32_t i = 0; i < nameLength && !br.overran(); i++) font.name += (char)u8();
+        while (!font.name.empty() && font.name.back() == '\0') font.name.pop_back();
+        font.numGlyphs = u16();
+    }
+    
+    // The code table offset doubles as the end of the last glyph
+    size_t numGlyphs = font.numGlyphs;
+    font.tableStart = br.getBytePos();
+    font.offsets.assign(numGlyphs + 1, 0);
+    for (size_t i = 0; i <= numGlyphs; i++) {
+        if (i == numGlyphs && tagType == TAG_DEFINE_FONT) {
+            font.offsets[i] = (uint32_t)(size - font.tableStart);
+            break;
+        }
+        if (numGlyphs == 0 && font.tableStart + (wideOffsets ? 4 : 2) > size) {
+            // Device fonts without glyphs may leave out the code table offset
+            break;
+        }
+        font.offsets[i] = wideOffsets ? (u16() | (u16() << 16)) : u16();
+    }
+    if (br.overran() || (numGlyphs > 0 && font.offsets[numGlyphs] > size - font.tableStart)) return false;
+    uint32_t codeTableOffset = font.offsets[numGlyphs];
+    for (size_t i = 0; i < numGlyphs; i++) font.offsets[i] = std::min(font.offsets[i], codeTableOffset);
+    
+    if (tagType != TAG_DEFINE_FONT) {
+        br.setBytePos(font.tableStart + codeTableOffset);
+        font.codes.reserve(numGlyphs);
+        for (size_t i = 0; i < numGlyphs; i++) {
+            uint16_t code = font.wideCodes ? u16() : u8();
+            if (br.overran()) {
+                font.truncated = true;
+                break;
+            }
+            font.codes.push_back(code);
+        }
+        font.layoutStart = br.getBytePos();
+    }
+    return true;
+}
+
+// Glyph code to UTF-8; lone surrogates become U+FFFD
+static void appendUtf8(std::string& out, uint32_t code) {
+    if (code >= 0xD800 && code <= 0xDFFF) code = 0xFFFD;
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    } else {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+static std::string xmlEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+// Store files claimed by any extractor in the process. Batch tasks and
+// nested SWFs each have their own SWFExtractor and OutputWriter over the
+// same store, so the claim has to be process-wide for exactly one of
+// them to write a given file.
+class StoreClaims {
+    std::mutex mutex;
+    std::set<std::string> paths;
+
+public:
+    static StoreClaims& shared() {
+        static StoreClaims claims;
+        return claims;
+    }
+
+    // False when the file is already claimed
+    bool claim(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return paths.insert(path).second;
+    }
+
+    void release(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        paths.erase(path);
+    }
+};
+
+// Performs file writes on a dedicated I/O thread so the parser never
+// waits on open/write/close. Requests are queued and the I/O thread
+// drains the whole queue at once, writing each file with a single
+// gathered write. Payloads either own their bytes or point at memory
+// the caller guarantees to keep alive until flush() returns (the input
+// mapping, for example), so large assets are never copied.
+class OutputWriter {
+public:
+    struct Segment {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // Describes a file for the pack index; loose output ignores it
+    struct AssetInfo {
+        int characterId;                 // -1 for files that are not characters
+        std::string type;
+        std::string metadata;
+
+        AssetInfo() : characterId(-1) {}
+        AssetInfo(int id, const std::string& t, const std::string& meta = "")
+            : characterId(id), type(t), metadata(meta) {}
+    };
+
+private:
+    struct Request {
+        std::string path;
+        std::vector<uint8_t> owned;
+        std::vector<Segment> segments;   // Empty means "write owned"
+        AssetInfo info;
+    };
+
+    std::deque<Request> queue;
+    std::mutex mutex;
+    std::condition_variable wake;        // Signals the I/O thread
+    std::condition_variable drained;     // Signals flush() and throttled writers
+    size_t queuedBytes;                  // Owned bytes waiting to be written
+    size_t inFlight;                     // Requests taken but not yet written
+    size_t failedWrites;
+    bool stopping;
+    PackWriter pack;                     // Only touched by the I/O thread once open
+    std::string packRoot;
+    std::string storeRoot;               // Files under it bypass the pack
+    size_t storeWrites;
+    OutputWriter* forward;               // Receives every request when set
+    std::thread worker;
+
+    // Owned payloads beyond this make write() wait for the I/O thread
+    static const size_t MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    static std::vector<Segment> segmentsOf(const Request& req) {
+        if (req.segments.empty() && !req.owned.empty()) {
+            return std::vector<Segment>{Segment{req.owned.data(), req.owned.size()}};
+        }
+        return req.segments;
+    }
+
+    bool appendToPack(const Request& req) {
+        std::string name = req.path;
+        if (name.compare(0, packRoot.size(), packRoot) == 0) {
+            name = name.substr(packRoot.size());
+        }
+        pack.beginEntry(name, req.info.type, req.info.characterId, req.info.metadata);
+        for (const Segment& seg : segmentsOf(req)) {
+            pack.write(seg.data, seg.size);
+        }
+        return pack.endEntry();
+    }
+
+    // Shared store files are written under a temporary name and renamed
+    // into place, so concurrent runs never see a partial file. The name is
+    // unique per write: another writer in this process or another process
+    // may be producing the same store file at the same time.
+    static bool writeFile(const Request& req, bool atomic) {
+        std::vector<Segment> all = segmentsOf(req);
+        const std::vector<Segment>* segments = &all;
+#ifdef _WIN32
+        (void)atomic;
+        std::ofstream out(req.path, std::ios::binary);
+        if (!out.is_open()) return false;
+        for (const Segment& seg : *segments) {
+            out.write((const char*)seg.data, seg.size);
+        }
+        return out.good();
+#else
+        static std::atomic<uint64_t> tempCount(0);
+        std::string target = req.path;
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        if (atomic) {
+            target += ".tmp" + std::to_string(getpid()) + "_" + std::to_string(tempCount++);
+            flags = O_WRONLY | O_CREAT | O_EXCL;
+        }
+        int fd = ::open(target.c_str(), flags, 0644);
+        if (fd < 0) return false;
+        std::vector<struct iovec> iov;
+        iov.reserve(segments->size());
+        for (const Segment& seg : *segments) {
+            if (seg.size > 0) iov.push_back(iovec{(void*)seg.data, seg.size});
+        }
+        bool ok = true;
+        size_t first = 0;
+        while (first < iov.size()) {
+            int count = (int)std::min<size_t>(iov.size() - first, IOV_MAX);
+            ssize_t written = ::writev(fd, &iov[first], count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            // Skip fully written vectors and trim a partially written one
+            size_t remaining = written;
+            while (first < iov.size() && remaining >= iov[first].iov_len) {
+                remaining -= iov[first].iov_len;
+                first++;
+            }
+            if (remaining > 0) {
+                iov[first].iov_base = (uint8_t*)iov[first].iov_base + remaining;
+                iov[first].iov_len -= remaining;
+            }
+        }
+        if (::close(fd) != 0) ok = false;
+        if (atomic) {
+            if (ok && ::rename(target.c_str(), req.path.c_str()) != 0) ok = false;
+            if (!ok) ::unlink(target.c_str());
+        }
+        return ok;
+#endif
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty() && stopping) return;
+
+            std::deque<Request> batch;
+            batch.swap(queue);
+            inFlight = batch.size();
+            lock.unlock();
+
+            size_t released = 0;
+            size_t failures = 0;
+            size_t stores = 0;
+            for (Request& req : batch) {
+                bool stored = !storeRoot.empty() && req.path.compare(0, storeRoot.size(), storeRoot) == 0;
+                bool ok = (pack.isOpen() && !stored) ? appendToPack(req) : writeFile(req, stored);
+                if (ok && stored) stores++;
+                if (!ok) {
+                    std::cerr << "Failed to write " << req.path << std::endl;
+                    // Lets a later asset with the same bytes try again
+                    if (stored) StoreClaims::shared().release(req.path);
+                    failures++;
+                }
+                released += req.owned.size();
+            }
+
+            lock.lock();
+            queuedBytes -= released;
+            failedWrites += failures;
+            storeWrites += stores;
+            inFlight = 0;
+            drained.notify_all();
+        }
+    }
+
+    void enqueue(Request&& req) {
+        if (forward) {
+            forward->enqueue(std::move(req));
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queuedBytes > MAX_QUEUED_BYTES) {
+            drained.wait(lock, [this] { return queuedBytes <= MAX_QUEUED_BYTES; });
+        }
+        queuedBytes += req.owned.size();
+        queue.push_back(std::move(req));
+        wake.notify_one();
+    }
+
+public:
+    OutputWriter() : queuedBytes(0), inFlight(0), failedWrites(0), stopping(false), storeWrites(0), forward(nullptr) {
+        worker = std::thread(&OutputWriter::run, this);
+    }
+
+    ~OutputWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    // Sends every following write into one pack file instead of loose
+    // files. Paths under root are stored relative to it.
+    bool openPack(const std::string& packPath, const std::string& root) {
+        std::lock_guard<std::mutex> lock(mutex);
+        packRoot = root;
+        return pack.open(packPath);
+    }
+
+    // Hands every following write to parent, which must outlive this
+    // writer. A nested SWF uses it to add its files to the parent's pack,
+    // named by their path under the parent's output directory.
+    void forwardTo(OutputWriter& parent) {
+        std::lock_guard<std::mutex> lock(mutex);
+        forward = &parent;
+    }
+
+    // Paths under root belong to the shared asset store: they are always
+    // written as loose files, atomically
+    void setStore(const std::string& root) {
+        std::lock_guard<std::mutex> lock(mutex);
+        storeRoot = root;
+    }
+
+    // Waits for pending writes and appends the pack index. A forwarding
+    // writer leaves the parent's pack open.
+    bool closePack() {
+        flush();
+        if (forward) return true;
+        std::lock_guard<std::mutex> lock(mutex);
+        return pack.isOpen() && pack.close();
+    }
+
+    // Takes ownership of bytes
+    void write(const std::string& path, std::vector<uint8_t>&& bytes, const AssetInfo& info = AssetInfo()) {
+        Request req;
+        req.path = path;
+        req.owned = std::move(bytes);
+        req.info = info;
+        enqueue(std::move(req));
+    }
+
+    void write(const std::string& path, const std::string& text, const AssetInfo& info = AssetInfo()) {
+        write(path, std::vector<uint8_t>(text.begin(), text.end()), info);
+    }
+
+    // Writes the segments back to back without copying them. They must
+    // stay valid until flush() returns; owned is kept alive alongside
+    // them for segments that point into it.
+    void writeGather(const std::string& path, std::vector<Segment>&& segments,
+                     std::vector<uint8_t>&& owned = std::vector<uint8_t>(),
+                     const AssetInfo& info = AssetInfo()) {
+        Request req;
+        req.path = path;
+        req.segments = std::move(segments);
+        req.owned = std::move(owned);
+        req.info = info;
+        enqueue(std::move(req));
+    }
+
+    void writeView(const std::string& path, const uint8_t* bytes, size_t size, const AssetInfo& info = AssetInfo()) {
+        writeGather(path, std::vector<Segment>{Segment{bytes, size}}, std::vector<uint8_t>(), info);
+    }
+
+    // Blocks until every queued write has reached the filesystem
+    void flush() {
+        if (forward) {
+            forward->flush();
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        drained.wait(lock, [this] { return queue.empty() && inFlight == 0; });
+    }
+
+    size_t failures() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failedWrites;
+    }
+
+    size_t storedFiles() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return storeWrites;
+    }
+};
+
+enum Verbosity {
+    LOG_QUIET = 0,      // Errors only
+    LOG_NORMAL = 1,     // Header and summary
+    LOG_VERBOSE = 2     // One line per tag
+};
+
+// Builds one flat JSON object, used for manifest records
+class JsonRecord {
+    std::string body;
+
+    void key(const char* name) {
+        if (!body.empty()) body += ',';
+        body += '"';
+        body += name;
+        body += "\":";
+    }
+
+public:
+    static std::string escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if ((unsigned char)c < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        out += buf;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        return out;
+    }
+
+    JsonRecord& add(const char* name, const std::string& value) {
+        key(name);
+        body += '"' + escape(value) + '"';
+        return *this;
+    }
+
+    JsonRecord& add(const char* name, const char* value) { return add(name, std::string(value)); }
+
+    JsonRecord& add(const char* name, bool value) {
+        key(name);
+        body += value ? "true" : "false";
+        return *this;
+    }
+
+    template <typename T>
+    JsonRecord& add(const char* name, T value) {
+        key(name);
+        body += std::to_string(value);
+        return *this;
+    }
+
+    // Adds an already encoded JSON value, such as a nested object or array
+    JsonRecord& addRaw(const char* name, const std::string& json) {
+        key(name);
+        body += json;
+        return *this;
+    }
+
+    std::string str() const { return "{" + body + "}"; }
+};
+
+// One entry per top-level tag, built by a cheap first pass so the second
+// pass can hand independent tags to the worker pool
+struct TagRecord {
+    uint16_t type;
+    uint16_t characterId;   // 0 for tags that do not define a character
+    uint32_t frame;         // Frame the tag belongs to, counted from 0
+    uint32_t length;        // Payload length
+    uint64_t offset;        // Payload offset within the tag stream
+};
+
+// A timeline sound stream: a SoundStreamHead and the SoundStreamBlock
+// tags that follow it on the same timeline, collected until that
+// timeline ends or starts another stream
+struct SoundStream {
+    int index;                  // Order of its SoundStreamHead in the file
+    int32_t timelineId;         // MAIN_TIMELINE or the sprite it plays in
+    uint64_t offset;            // Head payload offset in the uncompressed SWF
+    int format;                 // Compression, numbered as in DefineSound
+    uint32_t rate;
+    int channels;
+    int bits;
+    uint32_t samples;           // Sum of the MP3 blocks' sample counts
+    size_t blocks;
+    std::vector<OutputWriter::Segment> segments;   // Block data left in the input
+    std::vector<uint8_t> owned;                    // WAV header, then copied or decoded data
+
+    SoundStream() : index(0), timelineId(MAIN_TIMELINE), offset(0), format(0), rate(0), channels(1),
+                    bits(16), samples(0), blocks(0) {}
+
+    // ADPCM is decoded, and PCM kept, as a 16-bit (or 8-bit PCM) WAV
+    bool isWav() const { return format == 0 || format == 1 || format == 3; }
+};
+
+// A DefineVideoStream and the VideoFrame tags that refer to it
+struct VideoStream {
+    struct Frame {
+        const uint8_t* data;    // Into the input, or an offset into owned while streaming
+        size_t size;
+        uint16_t number;        // FrameNum of the VideoFrame tag
+        uint8_t type;           // FLV frame type
+    };
+
+    uint64_t offset;            // DefineVideoStream payload offset in the uncompressed SWF
+    uint16_t declaredFrames;
+    uint16_t width;
+    uint16_t height;
+    int codec;
+    std::vector<Frame> frames;
+    std::vector<uint8_t> owned; // Frame payloads copied from the stream window
+
+    VideoStream() : offset(0), declaredFrames(0), width(0), height(0), codec(0) {}
+};
+
+// One DefineSprite's timeline, built from its tag list independently of
+// every other timeline. Tags that feed state shared between timelines
+// (sound streams, video frames) are only noted here, and are replayed in
+// input order when the sprite is merged.
+struct SpriteTrack {
+    DisplayList list;
+    TimelineWriter timeline;
+    std::string meta;               // sprite_N_info.txt
+    int frames;
+    int actions;
+    std::vector<TagRecord> deferred;
+
+    SpriteTrack() : frames(0), actions(0) {}
+};
+
+// ==========================================
+// Character Dependencies
+// ==========================================
+
+// Reads the character ids a definition refers to straight from its tag
+// payload: sprites and buttons to the characters they place, shapes to
+// their bitmap fills, texts to their fonts. Only the fields up to each
+// reference are decoded. A definition that cannot be parsed to the end
+// yields the references found before the problem.
+class DependencyScanner {
+    BitReader br;
+    int shapeVersion;
+    std::vector<uint16_t>& deps;
+
+    DependencyScanner(const uint8_t* payload, size_t size, std::vector<uint16_t>& out)
+        : br(payload, size), shapeVersion(1), deps(out) {}
+
+    uint32_t u8() {
+        br.alignByte();
+        return br.readBits(8);
+    }
+
+    uint32_t u16() {
+        uint32_t lo = u8();
+        return lo | (u8() << 8);
+    }
+
+    void skipBytes(size_t n) {
+        br.alignByte();
+        br.setBytePos(br.getBytePos() + n);
+    }
+
+    void skipRect() {
+        br.alignByte();
+        int nBits = br.readBits(5);
+        br.readBits(nBits);
+        br.readBits(nBits);
+        br.readBits(nBits);
+        br.readBits(nBits);
+    }
+
+    void skipMatrix() {
+        br.alignByte();
+        if (br.readBits(1)) {
+            int nBits = br.readBits(5);
+            br.readBits(nBits);
+            br.readBits(nBits);
+        }
+        if (br.readBits(1)) {
+            int nBits = br.readBits(5);
+            br.readBits(nBits);
+            br.readBits(nBits);
+        }
+        int nBits = br.readBits(5);
+        br.readBits(nBits);
+        br.readBits(nBits);
+    }
+
+    void skipColorTransformWithAlpha() {
+        br.alignByte();
+        bool hasAdd = br.readBits(1);
+        bool hasMult = br.readBits(1);
+        int nBits = br.readBits(4);
+        if (hasMult) for (int i = 0; i < 4; i++) br.readBits(nBits);
+        if (hasAdd) for (int i = 0; i < 4; i++) br.readBits(nBits);
+    }
+
+    bool fillStyle() {
+        uint32_t type = u8();
+        if (type == 0x00) {
+            skipBytes(shapeVersion >= 3 ? 4 : 3);
+        } else if (type == 0x10 || type == 0x12 || type == 0x13) {
+            skipMatrix();
+            uint32_t count = u8() & 0x0F;
+            skipBytes(count * (shapeVersion >= 3 ? 5 : 4));
+            if (type == 0x13) skipBytes(2);
+        } else if (type >= 0x40 && type <= 0x43) {
+            deps.push_back((uint16_t)u16());
+            skipMatrix();
+        } else {
+            return false;
+        }
+        return !br.overran();
+    }
+
+    bool fillStyles() {
+        uint32_t count = u8();
+        if (count == 0xFF && shapeVersion >= 2) count = u16();
+        for (uint32_t i = 0; i < count; i++) {
+            if (!fillStyle()) return false;
+        }
+        return true;
+    }
+
+    bool lineStyles() {
+        uint32_t count = u8();
+        if (count == 0xFF && shapeVersion >= 2) count = u16();
+        for (uint32_t i = 0; i < count; i++) {
+            skipBytes(2);   // Width
+            if (shapeVersion >= 4) {
+                uint32_t flags = u8();
+                u8();
+                if (((flags >> 4) & 3) == 2) skipBytes(2);   // Miter limit
+                if (flags & 0x08) {
+                    if (!fillStyle()) return false;
+                } else {
+                    skipBytes(4);
+                }
+            } else {
+                skipBytes(shapeVersion >= 3 ? 4 : 3);
+            }
+        }
+        return !br.overran();
+    }
+
+    void shape() {
+        u16();   // Character id
+        skipRect();
+        if (shapeVersion == 4) {
+            skipRect();
+            skipBytes(1);
+        }
+        if (!fillStyles() || !lineStyles()) return;
+
+        // Walk the records for StyleChange records that bring new styles
+        ShapeRecordDecoder records(br);
+        records.readStyleBits();
+        ShapeRecord rec;
+        while (records.next(rec)) {
+            if (rec.type == ShapeRecord::STYLE_CHANGE && rec.hasNewStyles && shapeVersion >= 2) {
+                if (!fillStyles() || !lineStyles()) return;
+                records.readStyleBits();
+            }
+        }
+    }
+
+    // Morph shapes only take fill styles at the start; their edges never
+    // introduce new ones
+    void morphShape(bool version2) {
+        u16();
+        skipRect();
+        skipRect();
+        if (version2) {
+            skipRect();
+            skipRect();
+            skipBytes(1);
+        }
+        skipBytes(4);   // Offset to the end edges
+        uint32_t count = u8();
+        if (count == 0xFF) count = u16();
+        for (uint32_t i = 0; i < count && !br.overran(); i++) {
+            uint32_t type = u8();
+            if (type == 0x00) {
+                skipBytes(8);
+            } else if (type == 0x10 || type == 0x12) {
+                skipMatrix();
+                skipMatrix();
+                skipBytes(u8() * 10);
+            } else if (type >= 0x40 && type <= 0x43) {
+                deps.push_back((uint16_t)u16());
+                skipMatrix();
+                skipMatrix();
+            } else {
+                return;
+            }
+        }
+    }
+
+    void sprite() {
+        u16();
+        u16();   // Frame count
+        while (!br.overran()) {
+            uint32_t codeAndLength = u16();
+            uint32_t tagType = codeAndLength >> 6;
+            size_t length = codeAndLength & 0x3F;
+            if (length == 0x3F) {
+                length = u16();
+                length |= (size_t)u16() << 16;
+            }
+            if (tagType == TAG_END) break;
+            size_t next = br.getBytePos() + length;
+            if (tagType == TAG_PLACE_OBJECT) {
+                deps.push_back((uint16_t)u16());
+            } else if (tagType == TAG_PLACE_OBJECT2 || tagType == TAG_PLACE_OBJECT3) {
+                uint32_t flags = u8();
+                if (tagType == TAG_PLACE_OBJECT3) {
+                    uint32_t flags2 = u8();
+                    u16();
+                    // Class name, also present for an image with a character
+                    if ((flags2 & 0x08) || ((flags2 & 0x10) && (flags & 0x02))) {
+                        while (!br.overran() && u8() != 0) {}
+                    }
+                } else {
+                    u16();
+                }
+                if (flags & 0x02) deps.push_back((uint16_t)u16());
+            }
+            br.setBytePos(next);
+        }
+    }
+
+    void button(bool version2) {
+        u16();
+        if (version2) skipBytes(3);   // Flags and action offset
+        while (!br.overran()) {
+            uint32_t flags = u8();
+            if (flags == 0) break;
+            deps.push_back((uint16_t)u16());
+            skipBytes(2);   // Depth
+            skipMatrix();
+            if (version2) {
+                skipColorTransformWithAlpha();
+                if (flags & 0x10) return;   // Filter lists are not parsed
+                if (flags & 0x20) skipBytes(1);
+            }
+        }
+    }
+
+    void text(bool hasAlpha) {
+        u16();
+        skipRect();
+        skipMatrix();
+        int glyphBits = u8();
+        int advanceBits = u8();
+        if (glyphBits > 32 || advanceBits > 32) return;   // Corrupt, readBits takes at most 32
+        while (!br.overran()) {
+            uint32_t flags = u8();
+            if (flags == 0) break;
+            if (flags & 0x08) deps.push_back((uint16_t)u16());
+            if (flags & 0x04) skipBytes(hasAlpha ? 4 : 3);
+            if (flags & 0x01) skipBytes(2);
+            if (flags & 0x02) skipBytes(2);
+            if (flags & 0x08) skipBytes(2);   // Height
+            uint32_t glyphs = u8();
+            for (uint32_t i = 0; i < glyphs; i++) {
+                br.readBits(glyphBits);
+                br.readBits(advanceBits);
+            }
+        }
+    }
+
+    void editText() {
+        u16();
+        skipRect();
+        uint32_t flags = u8();
+        u8();
+        if (flags & 0x01) deps.push_back((uint16_t)u16());
+    }
+
+public:
+    static void collect(uint16_t tagType, const uint8_t* payload, size_t size, std::vector<uint16_t>& deps) {
+        DependencyScanner scan(payload, size, deps);
+        size_t before = deps.size();
+        switch (tagType) {
+            case TAG_DEFINE_SHAPE: scan.shapeVersion = 1; scan.shape(); break;
+            case TAG_DEFINE_SHAPE2: scan.shapeVersion = 2; scan.shape(); break;
+            case TAG_DEFINE_SHAPE3: scan.shapeVersion = 3; scan.shape(); break;
+            case TAG_DEFINE_SHAPE4: scan.shapeVersion = 4; scan.shape(); break;
+            case TAG_DEFINE_MORPH_SHAPE: scan.morphShape(false); break;
+            case TAG_DEFINE_MORPH_SHAPE2: scan.morphShape(true); break;
+            case TAG_DEFINE_SPRITE: scan.sprite(); break;
+            case TAG_DEFINE_BUTTON: scan.button(false); break;
+            case TAG_DEFINE_BUTTON2: scan.button(true); break;
+            case TAG_DEFINE_TEXT: scan.text(false); break;
+            case TAG_DEFINE_TEXT2: scan.text(true); break;
+            case TAG_DEFINE_EDIT_TEXT: scan.editText(); break;
+            default: break;
+        }
+        // Bitmap fill id 0xFFFF means "no bitmap"
+        deps.erase(std::remove(deps.begin() + before, deps.end(), 0xFFFF), deps.end());
+    }
+};
+
+// ==========================================
+// Incremental Extraction Cache
+// ==========================================
+//
+// With --incremental, extract.cache in the output directory remembers the
+// last run: the input's size, mtime and XXH64, and for every asset tag a
+// hash of its payload together with what extracting it produced. Layout
+// (all integers little-endian):
+//
+//   "SWFCACHE"                      8-byte magic
+//   u32 version
+//   u32 length, settings            options the outputs depend on
+//   u64 inputSize
+//   i64 inputMtime
+//   u64 inputHash
+//   u32 entryCount, then per entry:
+//     u64 hash                      XXH64 of the payload, seeded per tag type
+//     u64 sizeAndType               payload length << 16 | tag type
+//     u32 count, records            i64 offset from the payload, u32 length, manifest line
+//     u32 count, characters         i32 id, u32 length, path, u32 length, type
+//     u32 count, files              u32 length, path
+
+static const char CACHE_MAGIC[8] = {'S', 'W', 'F', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t CACHE_VERSION = 1;
+
+// Everything one asset tag contributed to the run
+struct CachedTag {
+    struct Record {
+        int64_t delta;               // Manifest offset minus the payload offset
+        std::string json;
+    };
+    struct Character {
+        int32_t id;
+        std::string path;
+        std::string type;
+    };
+    
+    std::vector<Record> records;
+    std::vector<Character> characters;
+    std::vector<std::string> files;
+    const void* owner;               // Extractor recording into it
+    uint64_t base;                   // Input offset of the payload
+    
+    CachedTag() : owner(nullptr), base(0) {}
+};
+
+class ExtractCache {
+    static void putU32(std::string& buf, uint32_t v) {
+        for (int i = 0; i < 4; i++) buf += (char)((v >> (8 * i)) & 0xFF);
+    }
+    
+    static void putU64(std::string& buf, uint64_t v) {
+        for (int i = 0; i < 8; i++) buf += (char)((v >> (8 * i)) & 0xFF);
+    }
+    
+    static void putString(std::string& buf, const std::string& s) {
+        putU32(buf, (uint32_t)s.size());
+        buf += s;
+    }
+    
+    // Bounds-checked cursor over a loaded cache file
+    struct Cursor {
+        const uint8_t* p;
+        size_t size;
+        size_t pos;
+        bool ok;
+        
+        uint64_t get(int bytes) {
+            if (!ok || size - pos < (size_t)bytes) {
+                ok = false;
+                return 0;
+            }
+            uint64_t v = 0;
+            for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[pos + i];
+            pos += bytes;
+            return v;
+        }
+        
+        std::string string() {
+            uint32_t length = (uint32_t)get(4);
+            if (!ok || size - pos < length) {
+                ok = false;
+                return std::string();
+            }
+            std::string s((const char*)p + pos, length);
+            pos += length;
+            return s;
+        }
+    };
+    
+public:
+    typedef std::pair<uint64_t, uint64_t> Key;
+    
+    std::string settings;
+    uint64_t inputSize;
+    int64_t inputMtime;
+    uint64_t inputHash;
+    std::map<Key, CachedTag> entries;
+    
+    ExtractCache() : inputSize(0), inputMtime(0), inputHash(0) {}
+    
+    static Key key(uint16_t tagType, const uint8_t* payload, size_t size, uint64_t salt) {
+        uint64_t seed = xxh64((const uint8_t*)&salt, sizeof(salt), tagType);
+        return Key(xxh64(payload, size, seed), ((uint64_t)size << 16) | tagType);
+    }
+    
+    // Returns false, leaving the cache empty, if the file is missing or corrupt
+    bool load(const std::string& path) {
+        entries.clear();
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return false;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (bytes.size() < sizeof(CACHE_MAGIC) || memcmp(bytes.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+            return false;
+        }
+        
+        Cursor c = {bytes.data(), bytes.size(), sizeof(CACHE_MAGIC), true};
+        if (c.get(4) != CACHE_VERSION) return false;
+        settings = c.string();
+        inputSize = c.get(8);
+        inputMtime = (int64_t)c.get(8);
+        inputHash = c.get(8);
+        uint32_t count = (uint32_t)c.get(4);
+        for (uint32_t i = 0; i < count && c.ok; i++) {
+            Key k;
+            k.first = c.get(8);
+            k.second = c.get(8);
+            CachedTag& tag = entries[k];
+            uint32_t records = (uint32_t)c.get(4);
+            for (uint32_t j = 0; j < records && c.ok; j++) {
+                CachedTag::Record r;
+                r.delta = (int64_t)c.get(8);
+                r.json = c.string();
+                tag.records.push_back(r);
+            }
+            uint32_t characters = (uint32_t)c.get(4);
+            for (uint32_t j = 0; j < characters && c.ok; j++) {
+                CachedTag::Character ch;
+                ch.id = (int32_t)c.get(4);
+                ch.path = c.string();
+                ch.type = c.string();
+                tag.characters.push_back(ch);
+            }
+            uint32_t files = (uint32_t)c.get(4);
+            for (uint32_t j = 0; j < files && c.ok; j++) {
+                tag.files.push_back(c.string());
+            }
+        }
+        if (!c.ok) {
+            entries.clear();
+            return false;
+        }
+        return true;
+    }
+    
+    std::string serialize() const {
+        std::string out(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        putU32(out, CACHE_VERSION);
+        putString(out, settings);
+        putU64(out, inputSize);
+        putU64(out, (uint64_t)inputMtime);
+        putU64(out, inputHash);
+        putU32(out, (uint32_t)entries.size());
+        for (auto& pair : entries) {
+            const CachedTag& tag = pair.second;
+            putU64(out, pair.first.first);
+            putU64(out, pair.first.second);
+            putU32(out, (uint32_t)tag.records.size());
+            for (auto& r : tag.records) {
+                putU64(out, (uint64_t)r.delta);
+                putString(out, r.json);
+            }
+            putU32(out, (uint32_t)tag.characters.size());
+            for (auto& ch : tag.characters) {
+                putU32(out, (uint32_t)ch.id);
+                putString(out, ch.path);
+                putString(out, ch.type);
+            }
+            putU32(out, (uint32_t)tag.files.size());
+            for (auto& f : tag.files) {
+                putString(out, f);
+            }
+        }
+        return out;
+    }
+};
+
+class SWFExtractor {
+    MappedFile input;
+    std::vector<uint8_t> inflated;   // Decompressed body, only used for CWS files
+    const uint8_t* data;             // Tag stream following the 8-byte header
+    size_t dataSize;
+    std::string outputDir;
+    int currentFrame;
+    int globalFrame;
+    std::map<int, std::string> characterMap;
+    std::map<int, std::string> characterTypes;
+    DisplayList displayList;
+    TimelineWriter timeline;         // Display list changes per frame
+    std::map<uint16_t, TimelineWriter> spriteTimelines;
+    DisplayList* stage;              // Display list PlaceObject tags apply to
+    TimelineWriter* track;           // and the timeline recording them
+    TimelineReader timelineIndex;    // Loaded by loadTimelineIndex() for seeking
+    std::vector<uint8_t> jpegTables;
+    bool streaming;
+    char compression;                // Signature byte: 'F', 'C' or 'Z'
+    const uint8_t* compressedBody;   // Points into the mapping when streaming
+    size_t compressedSize;
+    uint32_t uncompressedSize;       // Body length declared in the header
+    int swfVersion;
+    unsigned jobs;                   // Worker threads for asset extraction
+    WorkStealingPool* sharedPool;    // Batch mode: pool owned by the caller
+    std::vector<TagRecord> tagIndex;
+    bool packing;                    // Assets go to one pack file
+    int verbosity;                   // LOG_QUIET, LOG_NORMAL or LOG_VERBOSE
+    uint64_t dataBase;               // Offset of data[0] within the tag stream
+    std::vector<std::pair<uint64_t, std::string>> manifest;   // Keyed by input offset
+    std::string storeDir;            // Content-addressed asset store, empty when off
+    std::atomic<size_t> storeHits;
+    bool incremental;                // Reuse the outputs recorded in extract.cache
+    bool unchanged;                  // Input matches extract.cache, nothing to do
+    ExtractCache previousRun;        // Read-only once loadSWF() returns
+    ExtractCache thisRun;            // Entries guarded by stateMutex
+    std::atomic<size_t> cacheHits;
+    static thread_local CachedTag* capturing;   // Asset tag this thread is recording
+    std::set<std::string> onlyClasses;   // --only; empty keeps every class
+    std::set<int> onlyIds;               // --id, plus the ids --symbol names resolve to
+    std::set<std::string> onlySymbols;
+    bool filterIds;                      // Whether --id or --symbol was given
+    bool withDependencies;               // Widen onlyIds to everything they use
+    std::atomic<size_t> skippedTags;
+    int nestingDepth;                // 0 for the input file, +1 per enclosing DefineBinaryData
+    int maxNestingDepth;             // Embedded SWFs deeper than this are only dumped
+    uint64_t maxNestedSize;          // Nor are those declaring a larger uncompressed length
+    std::atomic<size_t> nestedCount;
+    std::map<int32_t, SoundStream> soundStreams;   // Open stream per timeline
+    int soundStreamCount;
+    std::map<uint16_t, VideoStream> videoStreams;  // By character id
+    std::map<uint16_t, std::vector<uint16_t>> fontCodes;   // Glyph index to character code, per font
+    std::vector<std::pair<uint64_t, std::string>> strings;  // strings.jsonl lines by input offset
+    uint16_t frameRate;              // 8.8 fixed point, from the movie header
+    int32_t timelineId;              // MAIN_TIMELINE or the sprite being processed
+    bool listingFiles;               // Collect outputFiles for the enclosing SWF's cache entry
+    std::vector<std::string> outputFiles;
+    int actionCount;
+    int abcCount;
+    std::mutex stateMutex;           // Guards characterMap/characterTypes/manifest
+    std::mutex consoleMutex;
+    OutputWriter writer;             // Declared after the input buffers so it drains first
+    
+    void createDirectory(const std::string& path) {
+        #ifdef _WIN32
+        _mkdir(path.c_str());
+        #else
+        mkdir(path.c_str(), 0755);
+        #endif
+    }
+    
+    void removeDirectory(const std::string& path) {
+        #ifdef _WIN32
+        _rmdir(path.c_str());
+        #else
+        rmdir(path.c_str());
+        #endif
+    }
+    
+    // Console output may come from worker threads; whole lines are
+    // written under a lock so they never interleave. Lines are not
+    // flushed individually.
+    template <typename... Args>
+    void logAt(int level, const Args&... args) {
+        if (verbosity < level) return;
+        std::ostringstream line;
+        (line << ... << args);
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        std::cout << line.str() << '\n';
+    }
+    
+    // One line per tag, only with --verbose
+    template <typename... Args>
+    void logTag(const Args&... args) { logAt(LOG_VERBOSE, args...); }
+    
+    template <typename... Args>
+    void logInfo(const Args&... args) { logAt(LOG_NORMAL, args...); }
+    
+    template <typename... Args>
+    void logError(const Args&... args) {
+        std::ostringstream line;
+        (line << ... << args);
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        std::cerr << line.str() << std::endl;
+    }
+    
+    void recordCharacter(int characterId, const std::string& file, const std::string& type) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (capturing && capturing->owner == this) {
+            capturing->characters.push_back(CachedTag::Character{characterId, file, type});
+        }
+        characterMap[characterId] = file;
+        characterTypes[characterId] = type;
+    }
+    
+    // Offset of an input byte within the uncompressed SWF, header included
+    uint64_t inputOffset(const uint8_t* p) const {
+        return 8 + dataBase + (p - data);
+    }
+    
+    std::string relativePath(const std::string& path) const {
+        if (path.compare(0, outputDir.size() + 1, outputDir + "/") == 0) {
+            return path.substr(outputDir.size() + 1);
+        }
+        return path;
+    }
+    
+    // Notes a file an asset tag produces, so the cache and the embedded SWF
+    // listing check that it still exists
+    void trackOutput(const std::string& file) {
+        if (capturing && capturing->owner == this) capturing->files.push_back(file);
+        if (listingFiles) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            outputFiles.push_back(file);
+        }
+    }
+    
+    // Starts a manifest record with the fields every asset has
+    JsonRecord assetRecord(int characterId, const std::string& type, const std::string& file,
+                           const uint8_t* payload, size_t size) {
+        trackOutput(file);
+        JsonRecord rec;
+        if (characterId >= 0) rec.add("id", characterId);
+        rec.add("type", type);
+        rec.add("offset", inputOffset(payload));
+        rec.add("size", (uint64_t)size);
+        rec.add("file", relativePath(file));
+        return rec;
+    }
+    
+    void addToManifest(const uint8_t* payload, const JsonRecord& rec) { addToManifest(payload, rec.str()); }
+    
+    void addToManifest(const uint8_t* payload, const std::string& json) {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (capturing && capturing->owner == this) {
+            capturing->records.push_back(CachedTag::Record{(int64_t)(inputOffset(payload) - capturing->base), json});
+        }
+        manifest.push_back(std::make_pair(inputOffset(payload), json));
+    }
+    
+    bool caching() const { return incremental && !packing; }
+    
+    // Options the outputs depend on; a cache written under others is ignored
+    std::string cacheSettings() const {
+        std::string settings = "out=" + outputDir + ";store=" + storeDir + ";only=";
+        for (const std::string& c : onlyClasses) settings += c + ",";
+        settings += ";ids=";
+        for (int id : onlyIds) settings += std::to_string(id) + ",";
+        settings += ";symbols=";
+        for (const std::string& name : onlySymbols) settings += name + ",";
+        if (withDependencies) settings += ";deps";
+        settings += ";nested=" + std::to_string(maxNestingDepth) + "," + std::to_string(maxNestedSize);
+        settings += ";keyframes=" + std::to_string(timeline.keyframeInterval());
+        return settings;
+    }
+    
+    // Compares the input with extract.cache. Size and mtime decide in
+    // O(1); when only the mtime moved, the content hash decides. Either
+    // way the outputs the last run recorded must all still exist. The
+    // per-tag entries stay loaded for extractCached().
+    bool checkCache(const std::string& filename) {
+        struct stat st;
+        thisRun.settings = cacheSettings();
+        thisRun.inputSize = input.size();
+        thisRun.inputMtime = stat(filename.c_str(), &st) == 0 ? (int64_t)st.st_mtime : 0;
+        
+        bool valid = previousRun.load(outputDir + "/extract.cache")
+                  && previousRun.settings == thisRun.settings
+                  && stat((outputDir + "/manifest.jsonl").c_str(), &st) == 0;
+        if (!valid) previousRun.entries.clear();
+        auto outputsExist = [this]() {
+            return std::all_of(previousRun.entries.begin(), previousRun.entries.end(),
+                               [](const std::pair<const ExtractCache::Key, CachedTag>& e) { return filesExist(e.second); });
+        };
+        if (valid && previousRun.inputSize == thisRun.inputSize && previousRun.inputMtime == thisRun.inputMtime
+                  && outputsExist()) {
+            return true;
+        }
+        
+        thisRun.inputHash = xxh64(input.data(), input.size(), 0);
+        if (valid && previousRun.inputSize == thisRun.inputSize && previousRun.inputHash == thisRun.inputHash
+                  && outputsExist()) {
+            // Touched but not modified: remember the new mtime
+            thisRun.entries = previousRun.entries;
+            saveCache();
+            return true;
+        }
+        return false;
+    }
+    
+    void saveCache() {
+        writer.flush();
+        if (writer.failures() > 0) return;
+        std::string bytes;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            bytes = thisRun.serialize();
+        }
+        writer.write(outputDir + "/extract.cache", bytes, OutputWriter::AssetInfo(-1, "cache"));
+        writer.flush();
+    }
+    
+    static bool filesExist(const CachedTag& tag) {
+        struct stat st;
+        for (const std::string& file : tag.files) {
+            if (stat(file.c_str(), &st) != 0) return false;
+        }
+        return true;
+    }
+    
+    // Rewrites the "offset" field of a manifest line from an earlier run
+    static std::string withOffset(const std::string& json, uint64_t offset) {
+        size_t at = json.find("\"offset\":");
+        if (at == std::string::npos) return json;
+        at += 9;
+        size_t end = json.find_first_not_of("0123456789", at);
+        if (end == std::string::npos) return json;
+        return json.substr(0, at) + std::to_string(offset) + json.substr(end);
+    }
+    
+    // Runs extract for one asset tag. With --incremental, a payload that
+    // the last run already extracted, and whose files are all still there,
+    // replays that run's manifest lines and characters instead.
+    void extractCached(uint16_t tagType, const uint8_t* payload, size_t size, uint64_t salt,
+                       const std::function<void()>& extract) {
+        if (!caching()) {
+            extract();
+            return;
+        }
+        
+        ExtractCache::Key key = ExtractCache::key(tagType, payload, size, salt);
+        uint64_t base = inputOffset(payload);
+        auto it = previousRun.entries.find(key);
+        if (it != previousRun.entries.end() && filesExist(it->second)) {
+            const CachedTag& tag = it->second;
+            std::lock_guard<std::mutex> lock(stateMutex);
+            for (const CachedTag::Record& r : tag.records) {
+                uint64_t offset = base + r.delta;
+                manifest.push_back(std::make_pair(offset, withOffset(r.json, offset)));
+            }
+            for (const CachedTag::Character& ch : tag.characters) {
+                characterMap[ch.id] = ch.path;
+                characterTypes[ch.id] = ch.type;
+            }
+            thisRun.entries[key] = tag;
+            cacheHits++;
+            return;
+        }
+        
+        CachedTag tag;
+        tag.owner = this;
+        tag.base = base;
+        CachedTag* outer = capturing;
+        capturing = &tag;
+        try {
+            extract();
+        } catch (...) {
+            capturing = outer;
+            throw;
+        }
+        capturing = outer;
+        std::lock_guard<std::mutex> lock(stateMutex);
+        thisRun.entries[key] = std::move(tag);
+    }
+    
+    // Output class of a tag for --only, named like the manifest "type";
+    // null for tags that only drive the timeline
+    static const char* tagClass(uint16_t tagType) {
+        switch (tagType) {
+            case TAG_DEFINE_SHAPE:
+            case TAG_DEFINE_SHAPE2:
+            case TAG_DEFINE_SHAPE3:
+            case TAG_DEFINE_SHAPE4:
+                return "shape";
+            case TAG_DEFINE_MORPH_SHAPE:
+            case TAG_DEFINE_MORPH_SHAPE2:
+                return "morph_shape";
+            case TAG_DEFINE_BITS:
+            case TAG_DEFINE_BITS_JPEG2:
+            case TAG_DEFINE_BITS_JPEG3:
+            case TAG_DEFINE_BITS_JPEG4:
+            case TAG_DEFINE_BITS_LOSSLESS:
+            case TAG_DEFINE_BITS_LOSSLESS2:
+                return "image";
+            case TAG_DEFINE_BINARY_DATA: return "binary";
+            case TAG_DEFINE_SOUND:
+            case TAG_SOUND_STREAM_HEAD:
+            case TAG_SOUND_STREAM_HEAD2:
+            case TAG_SOUND_STREAM_BLOCK:
+                return "sound";
+            case TAG_DEFINE_VIDEO_STREAM:
+            case TAG_VIDEO_FRAME:
+                return "video";
+            case TAG_DEFINE_FONT:
+            case TAG_DEFINE_FONT2:
+            case TAG_DEFINE_FONT3:
+                return "font";
+            case TAG_DEFINE_TEXT:
+            case TAG_DEFINE_TEXT2:
+            case TAG_DEFINE_EDIT_TEXT:
+                return "text";
+            case TAG_DO_ABC: return "abc";
+            case TAG_DO_ACTION: return "action";
+            default: return nullptr;
+        }
+    }
+    
+    bool filtering() const { return !onlyClasses.empty() || filterIds; }
+    
+    // Whether a tag passes --only/--id/--symbol. Only the first two payload
+    // bytes (the character id) are looked at, so a filtered tag is never
+    // decoded. Tags without a character id pass an id filter only when
+    // their class is named in --only.
+    bool wanted(uint16_t tagType, const uint8_t* payload, size_t length) const {
+        const char* cls = tagClass(tagType);
+        if (!cls) return true;
+        if (!onlyClasses.empty() && !onlyClasses.count(cls)) return false;
+        if (!filterIds) return true;
+        if (definesCharacter(tagType) || tagType == TAG_VIDEO_FRAME) {
+            // A VideoFrame starts with the id of its stream
+            return length >= 2 && onlyIds.count(payload[0] | (payload[1] << 8));
+        }
+        return onlyClasses.count(cls) > 0;
+    }
+    
+    // Keeps ABC and action numbering the same as in an unfiltered run
+    void skipTag(uint16_t tagType) {
+        skippedTags++;
+        if (tagType == TAG_DO_ABC) abcCount++;
+        if (tagType == TAG_DO_ACTION) actionCount++;
+    }
+    
+    // SymbolClass and ExportAssets usually follow the definitions they
+    // name, so --symbol names are bound to ids by a pass over the tag
+    // headers first. With --with-deps the same pass records what every
+    // definition refers to, and onlyIds grows to the transitive closure.
+    void scanCharacters(size_t pos) {
+        std::set<std::string> found;
+        std::map<int, std::vector<uint16_t>> dependencies;
+        while (pos + 2 <= dataSize) {
+            uint16_t tagCodeAndLength = readU16(pos);
+            uint16_t tagType = tagCodeAndLength >> 6;
+            uint32_t tagLength = tagCodeAndLength & 0x3F;
+            if (tagLength == 0x3F) {
+                tagLength = readU32(pos);
+            }
+            if (tagType == TAG_END) break;
+            size_t end = std::min<size_t>(pos + tagLength, dataSize);
+            
+            if (withDependencies && end - pos >= 2 && definesCharacter(tagType)) {
+                int id = data[pos] | (data[pos + 1] << 8);
+                DependencyScanner::collect(tagType, data + pos, end - pos, dependencies[id]);
+            }
+            
+            if (tagType == TAG_SYMBOL_CLASS || tagType == TAG_EXPORT_ASSETS) {
+                size_t p = pos;
+                uint16_t count = readU16(p);
+                for (uint16_t i = 0; i < count && p + 2 <= end; i++) {
+                    uint16_t id = readU16(p);
+                    std::string name;
+                    while (p < end && data[p] != 0) name += (char)data[p++];
+                    p++;
+                    if (onlySymbols.count(name)) {
+                        onlyIds.insert(id);
+                        found.insert(name);
+                    }
+                }
+            }
+            pos = end;
+        }
+        for (const std::string& name : onlySymbols) {
+            if (!found.count(name)) logError("No symbol named ", name);
+        }
+        
+        if (withDependencies) {
+            std::vector<int> pending(onlyIds.begin(), onlyIds.end());
+            while (!pending.empty()) {
+                int id = pending.back();
+                pending.pop_back();
+                auto it = dependencies.find(id);
+                if (it == dependencies.end()) continue;
+                for (uint16_t dep : it->second) {
+                    if (onlyIds.insert(dep).second) pending.push_back(dep);
+                }
+            }
+            logInfo("Dependency closure: ", onlyIds.size(), " characters");
+        }
+    }
+    
+    // processTag for the top-level tag stream: applies the filters, then
+    // goes through the cache for asset tags
+    void processTagCached(uint16_t tagType, uint32_t tagLength, size_t& pos) {
+        if (filtering() && pos <= dataSize
+                && !wanted(tagType, data + pos, std::min<size_t>(tagLength, dataSize - pos))) {
+            skipTag(tagType);
+            pos += tagLength;
+            return;
+        }
+        if (!caching() || !isAssetTag(tagType) || pos + tagLength > dataSize) {
+            processTag(tagType, tagLength, pos);
+            return;
+        }
+        
+        const uint8_t* payload = data + pos;
+        if (tagType == TAG_DO_ABC) {
+            int abcIndex = abcCount++;
+            extractCached(tagType, payload, tagLength, abcIndex, [&]() {
+                extractABC(payload, tagLength, abcIndex);
+            });
+            pos += tagLength;
+            return;
+        }
+        
+        // DefineBits images are completed by the JPEGTables in effect
+        uint64_t salt = tagType == TAG_DEFINE_BITS ? xxh64(jpegTables.data(), jpegTables.size(), 0) : 0;
+        size_t end = pos + tagLength;
+        bool extracted = false;
+        extractCached(tagType, payload, tagLength, salt, [&]() {
+            processTag(tagType, tagLength, pos);
+            extracted = true;
+        });
+        if (!extracted) pos = end;
+    }
+    
+    // With --store, moves an asset into the content-addressed store. The
+    // key is XXH64 over the input bytes the asset is decoded from, seeded
+    // with how it is decoded, followed by their total length; path becomes
+    // <store>/<first two digits>/<key><ext>. Sets present when the store
+    // already has the file or another extractor in this process is producing
+    // it, so the caller only records the reference. Returns "" when the
+    // store is off.
+    std::string storeAsset(const char* kind, const std::vector<std::pair<const uint8_t*, size_t>>& parts,
+                           const char* ext, std::string& path, bool& present) {
+        present = false;
+        if (storeDir.empty()) return "";
+        
+        uint64_t hash = xxh64((const uint8_t*)kind, strlen(kind), 0);
+        uint64_t length = 0;
+        for (auto& part : parts) {
+            hash = xxh64(part.first, part.second, hash);
+            length += part.second;
+        }
+        char key[33];
+        snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)hash, (unsigned long long)length);
+        path = storeDir + "/" + std::string(key, 2) + "/" + key + ext;
+        
+        present = !StoreClaims::shared().claim(path);
+        struct stat st;
+        if (!present && stat(path.c_str(), &st) == 0) present = true;
+        if (present) storeHits++;
+        return key;
+    }
+    
+    // Gives up a claim from storeAsset when the asset could not be
+    // produced, so a later tag with the same bytes writes it instead of
+    // pointing at a file that never appears
+    void releaseStoreClaim(const std::string& path) {
+        if (!storeDir.empty()) StoreClaims::shared().release(path);
+    }
+    
+    uint32_t readU32(size_t& pos) {
+        if (pos + 4 > dataSize) return 0;
+        uint32_t val = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | (data[pos+3] << 24);
+        pos += 4;
+        return val;
+    }
+    
+    uint16_t readU16(size_t& pos) {
+        if (pos + 2 > dataSize) return 0;
+        uint16_t val = data[pos] | (data[pos+1] << 8);
+        pos += 2;
+        return val;
+    }
+    
+    uint8_t readU8(size_t& pos) {
+        if (pos >= dataSize) return 0;
+        return data[pos++];
+    }
+    
+    std::string readString(size_t& pos) {
+        std::string result;
+        while (pos < dataSize && data[pos] != 0) {
+            result += (char)data[pos++];
+        }
+        if (pos < dataSize) pos++;
+        return result;
+    }
+    
+    Matrix readMatrix(BitReader& br) {
+        Matrix m;
+        bool hasScale = br.readBits(1);
+        if (hasScale) {
+            int nScaleBits = br.readBits(5);
+            m.a = br.readSignedBits(nScaleBits) / 65536.0;
+            m.d = br.readSignedBits(nScaleBits) / 65536.0;
+        }
+        bool hasRotate = br.readBits(1);
+        if (hasRotate) {
+            int nRotateBits = br.readBits(5);
+            m.c = br.readSignedBits(nRotateBits) / 65536.0;
+            m.b = br.readSignedBits(nRotateBits) / 65536.0;
+        }
+        int nTranslateBits = br.readBits(5);
+        m.tx = br.readSignedBits(nTranslateBits) / 20.0;
+        m.ty = br.readSignedBits(nTranslateBits) / 20.0;
+        return m;
+    }
+    
+    ColorTransform readColorTransform(BitReader& br, bool hasAlpha) {
+        ColorTransform ct;
+        bool hasAdd = br.readBits(1);
+        bool hasMult = br.readBits(1);
+        int nBits = br.readBits(4);
+        
+        if (hasMult) {
+            ct.rMult = br.readSignedBits(nBits);
+            ct.gMult = br.readSignedBits(nBits);
+            ct.bMult = br.readSignedBits(nBits);
+            if (hasAlpha) ct.aMult = br.readSignedBits(nBits);
+        }
+        if (hasAdd) {
+            ct.rAdd = br.readSignedBits(nBits);
+            ct.gAdd = br.readSignedBits(nBits);
+            ct.bAdd = br.readSignedBits(nBits);
+            if (hasAlpha) ct.aAdd = br.readSignedBits(nBits);
+        }
+        return ct;
+    }
+    
+    // Queues input bytes for writing. Outside streaming mode they live in
+    // the mapping or the inflated buffer until the extractor is destroyed,
+    // so the writer can take them by reference; the streaming window is
+    // reused for the next tag and has to be copied.
+    void writeInput(const std::string& path, const uint8_t* bytes, size_t size,
+                    const OutputWriter::AssetInfo& info = OutputWriter::AssetInfo()) {
+        if (compressedBody) {
+            writer.write(path, std::vector<uint8_t>(bytes, bytes + size), info);
+        } else {
+            writer.writeView(path, bytes, size, info);
+        }
+    }
+    
+    void extractShape(const uint8_t* shapeData, size_t shapeSize, int characterId, int shapeVersion) {
+        std::stringstream filename;
+        filename << outputDir << "/shape_" << characterId << ".dat";
+        std::string path = filename.str();
+        bool present;
+        std::string key = storeAsset("shape", {{shapeData, shapeSize}}, ".dat", path, present);
+        
+        JsonRecord rec = assetRecord(characterId, "shape", path, shapeData, shapeSize);
+        rec.add("version", shapeVersion);
+        if (!key.empty()) rec.add("hash", key);
+        addToManifest(shapeData, rec);
+        recordCharacter(characterId, path, "shape");
+        if (present) return;
+        
+        writeInput(path, shapeData, shapeSize, OutputWriter::AssetInfo(characterId, "shape", rec.str()));
+        logTag("Extracted shape: ", path, " (ID: ", characterId, ", v", shapeVersion, ")");
+    }
+    
+    void extractJPEG(const uint8_t* imgData, size_t imgSize, int characterId, bool hasTables) {
+        std::stringstream filename;
+        filename << outputDir << "/image_" << characterId << ".jpg";
+        std::string path = filename.str();
+        
+        bool mergeTables = hasTables && jpegTables.size() > 0 && imgSize > 2 && !(imgData[0] == 0xFF && imgData[1] == 0xD8);
+        bool present;
+        std::string key = mergeTables
+            ? storeAsset("jpeg", {{jpegTables.data(), jpegTables.size()}, {imgData, imgSize}}, ".jpg", path, present)
+            : storeAsset("jpeg", {{imgData, imgSize}}, ".jpg", path, present);
+        
+        JsonRecord rec = assetRecord(characterId, "image", path, imgData, imgSize);
+        rec.add("format", "jpeg");
+        rec.add("tables", mergeTables);
+        if (!key.empty()) rec.add("hash", key);
+        addToManifest(imgData, rec);
+        recordCharacter(characterId, path, "image");
+        if (present) return;
+        OutputWriter::AssetInfo asset(characterId, "image", rec.str());
+        
+        if (mergeTables) {
+            // The tables are copied since a later JPEGTables tag may replace them
+            size_t tableSize = jpegTables.size();
+            if (tableSize >= 2 && jpegTables[tableSize-2] == 0xFF && jpegTables[tableSize-1] == 0xD9) {
+                tableSize -= 2;
+            }
+            std::vector<uint8_t> owned(jpegTables.begin(), jpegTables.begin() + tableSize);
+            if (compressedBody) {
+                owned.insert(owned.end(), imgData, imgData + imgSize);
+                writer.write(path, std::move(owned), asset);
+            } else {
+                std::vector<OutputWriter::Segment> segments;
+                segments.push_back(OutputWriter::Segment{owned.data(), owned.size()});
+                segments.push_back(OutputWriter::Segment{imgData, imgSize});
+                writer.writeGather(path, std::move(segments), std::move(owned), asset);
+            }
+        } else {
+            writeInput(path, imgData, imgSize, asset);
+        }
+        logTag("Extracted JPEG: ", path, " (ID: ", characterId, ")");
+    }
+    
+    // Writes the zlib-compressed alpha plane of DefineBitsJPEG3/4 as an
+    // 8-bit grayscale PNG, image_N_alpha.png, matching the JPEG pixel for
+    // pixel. The plane is inflated one band of rows at a time straight
+    // into the PNG encoder, so memory use is a band and the compressed
+    // output, however large the image.
+    void extractAlphaMask(const uint8_t* imgData, size_t imgSize, const uint8_t* alphaData, size_t alphaSize,
+                          int characterId) {
+        uint32_t width = 0, height = 0;
+        if (!jpegDimensions(imgData, imgSize, width, height)) {
+            logError("No JPEG frame header for bitmap ", characterId, ", alpha plane skipped");
+            return;
+        }
+        
+        std::stringstream filename;
+        filename << outputDir << "/image_" << characterId << "_alpha.png";
+        std::string path = filename.str();
+        uint32_t dims[2] = {width, height};
+        bool present;
+        std::string key = storeAsset("alpha", {{(const uint8_t*)dims, sizeof(dims)}, {alphaData, alphaSize}},
+                                     ".png", path, present);
+        
+        JsonRecord rec = assetRecord(characterId, "alpha", path, alphaData, alphaSize);
+        rec.add("format", "png");
+        rec.add("width", width);
+        rec.add("height", height);
+        if (!key.empty()) rec.add("hash", key);
+        if (present) {
+            addToManifest(alphaData, rec);
+            return;
+        }
+        
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (inflateInit(&strm) != Z_OK) {
+            releaseStoreClaim(path);
+            return;
+        }
+        strm.next_in = (Bytef*)alphaData;
+        strm.avail_in = (uInt)alphaSize;
+        
+        PngEncoder::RowWriter png(width, height, PngEncoder::PNG_GRAY);
+        size_t rowsPerBand = std::max<size_t>(1, 64 * 1024 / width);
+        std::vector<uint8_t> band(rowsPerBand * width);
+        uint32_t rowsDone = 0;
+        bool truncated = false;
+        while (rowsDone < height) {
+            size_t rows = std::min<size_t>(rowsPerBand, height - rowsDone);
+            strm.next_out = band.data();
+            strm.avail_out = (uInt)(rows * width);
+            int result = Z_OK;
+            while (strm.avail_out > 0 && result == Z_OK) {
+                result = inflate(&strm, Z_NO_FLUSH);
+            }
+            if (strm.avail_out > 0) {
+                // Short or corrupt plane: the missing rows are transparent
+                memset(strm.next_out, 0, strm.avail_out);
+                truncated = true;
+            }
+            for (size_t r = 0; r < rows; r++) png.addRow(&band[r * width]);
+            rowsDone += rows;
+        }
+        inflateEnd(&strm);
+        if (truncated) logError("Alpha plane of bitmap ", characterId, " is truncated, padding with zeros");
+        
+        std::vector<uint8_t> bytes = png.finish();
+        if (bytes.empty()) {
+            logError("Failed to encode alpha plane of bitmap ", characterId);
+            releaseStoreClaim(path);
+            return;
+        }
+        
+        addToManifest(alphaData, rec);
+        writer.write(path, std::move(bytes), OutputWriter::AssetInfo(characterId, "alpha", rec.str()));
+        logTag("Extracted alpha plane: ", path, " (", width, "x", height, ")");
+    }
+    
+    // Bytes of decompressed DefineBitsLossless data: the color table for
+    // format 3, then rows padded to 32 bits
+    static size_t losslessSize(size_t width, size_t height, int format, int colorTableSize, bool hasAlpha) {
+        switch (format) {
+            case 3: return (size_t)(colorTableSize + 1) * (hasAlpha ? 4 : 3) + ((width + 3) & ~(size_t)3) * height;
+            case 4: return ((width * 2 + 3) & ~(size_t)3) * height;
+            case 5: return width * height * 4;
+            default: return 0;
+        }
+    }
+    
+    // bitmapData is the zlib-compressed bitmap; tagData/tagSize describe the
+    // whole tag payload for the manifest
+    void extractPNG(const uint8_t* bitmapData, size_t bitmapSize, size_t width, size_t height, int format,
+                    int colorTableSize, int characterId, bool hasAlpha, const uint8_t* tagData, size_t tagSize) {
+        std::stringstream filename;
+        filename << outputDir << "/image_" << characterId << ".png";
+        std::string path = filename.str();
+        
+        size_t expected = losslessSize(width, height, format, colorTableSize, hasAlpha);
+        if (expected == 0 || width == 0 || height == 0) {
+            logError("Unsupported bitmap ", characterId, " (format ", format, ", ", width, "x", height, ")");
+            return;
+        }
+        
+        // Everything after the character id determines the image
+        bool present;
+        std::string key = storeAsset(hasAlpha ? "lossless2" : "lossless", {{tagData + 2, tagSize - 2}},
+                                     ".png", path, present);
+        
+        JsonRecord rec = assetRecord(characterId, "image", path, tagData, tagSize);
+        rec.add("format", "png");
+        rec.add("bitmapFormat", format);
+        rec.add("width", (uint64_t)width);
+        rec.add("height", (uint64_t)height);
+        rec.add("pixels", format == 3 ? "palette" : format == 5 && hasAlpha ? "rgba" : "rgb");
+        if (!key.empty()) rec.add("hash", key);
+        if (present) {
+            addToManifest(tagData, rec);
+            recordCharacter(characterId, path, "image");
+            return;
+        }
+        
+        std::vector<uint8_t> raw(expected);
+        uLongf destLen = raw.size();
+        int result = uncompress(raw.data(), &destLen, bitmapData, bitmapSize);
+        if (result != Z_OK && !(result == Z_BUF_ERROR && destLen == raw.size())) {
+            logError("Failed to decompress bitmap ", characterId);
+            releaseStoreClaim(path);
+            return;
+        }
+        raw.resize(destLen);
+        if (raw.size() < expected) {
+            logError("Bitmap ", characterId, " is truncated, padding with zeros");
+            raw.resize(expected);
+        }
+        
+        // Strip the row padding and convert to 8-bit RGB/RGBA or palette
+        // indices. Lossless2 colors are premultiplied and come out as
+        // straight alpha.
+        PngEncoder::ColorType colorType;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> palette;
+        std::vector<uint8_t> alphas;
+        if (format == 3) {
+            colorType = PngEncoder::PNG_PALETTE;
+            int entries = colorTableSize + 1;
+            int entrySize = hasAlpha ? 4 : 3;
+            for (int i = 0; i < entries; i++) {
+                const uint8_t* c = &raw[i * entrySize];
+                if (hasAlpha) {
+                    // Lossless2 table entries are premultiplied RGBA
+                    for (int k = 0; k < 3; k++) palette.push_back(unpremultiplyChannel(c[k], c[3]));
+                    alphas.push_back(c[3]);
+                } else {
+                    palette.insert(palette.end(), c, c + 3);
+                }
+            }
+            size_t stride = (width + 3) & ~(size_t)3;
+            const uint8_t* rows = &raw[entries * entrySize];
+            pixels.resize(width * height);
+            for (size_t y = 0; y < height; y++) {
+                memcpy(&pixels[y * width], rows + y * stride, width);
+            }
+        } else if (format == 4) {
+            // PIX15: 1 pad bit and 5 bits each of red, green and blue
+            colorType = PngEncoder::PNG_RGB;
+            size_t stride = (width * 2 + 3) & ~(size_t)3;
+            pixels.resize(width * height * 3);
+            for (size_t y = 0; y < height; y++) {
+                const uint8_t* src = &raw[y * stride];
+                uint8_t* dst = &pixels[y * width * 3];
+                for (size_t x = 0; x < width; x++) {
+                    uint16_t v = (src[2 * x] << 8) | src[2 * x + 1];
+                    int r = (v >> 10) & 0x1F, g = (v >> 5) & 0x1F, b = v & 0x1F;
+                    dst[3 * x] = (uint8_t)((r << 3) | (r >> 2));
+                    dst[3 * x + 1] = (uint8_t)((g << 3) | (g >> 2));
+                    dst[3 * x + 2] = (uint8_t)((b << 3) | (b >> 2));
+                }
+            }
+        } else {
+            // PIX24 (pad, R, G, B) or ARGB
+            colorType = hasAlpha ? PngEncoder::PNG_RGBA : PngEncoder::PNG_RGB;
+            size_t count = width * height;
+            if (hasAlpha) {
+                pixels.swap(raw);
+                pixels.resize(count * 4);
+                argbToRgba(pixels.data(), count);
+            } else {
+                pixels.resize(count * 3);
+                for (size_t i = 0; i < count; i++) {
+                    memcpy(&pixels[3 * i], &raw[4 * i + 1], 3);
+                }
+            }
+        }
+        std::vector<uint8_t>().swap(raw);
+        
+        std::vector<uint8_t> png = PngEncoder::encode(pixels.data(), (uint32_t)width, (uint32_t)height,
+                                                      colorType, palette, alphas);
+        if (png.empty()) {
+            logError("Failed to encode bitmap ", characterId);
+            releaseStoreClaim(path);
+            return;
+        }
+        
+        addToManifest(tagData, rec);
+        writer.write(path, std::move(png), OutputWriter::AssetInfo(characterId, "image", rec.str()));
+        logTag("Extracted bitmap: ", path, " (", width, "x", height, ")");
+        recordCharacter(characterId, path, "image");
+    }
+    
+    // Whether a DefineBinaryData payload is itself a SWF worth extracting:
+    // a known signature, and a declared length that fits the limits
+    bool isEmbeddedSwf(const uint8_t* p, size_t size) const {
+        if (nestingDepth >= maxNestingDepth || size < 16) return false;
+        if ((p[0] != 'F' && p[0] != 'C' && p[0] != 'Z') || p[1] != 'W' || p[2] != 'S') return false;
+        uint32_t length = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+        if (p[3] == 0 || length < 16 || length > maxNestedSize) return false;
+        // An uncompressed body cannot be longer than the payload holding it
+        return p[0] != 'F' || length <= size;
+    }
+    
+    // Extracts an embedded SWF into outputDir/<name>/ straight from the
+    // payload, on the pool this thread works for if any. Returns its
+    // manifest lines tagged with "ns", each preceded by a newline, once
+    // its files are written, so the payload only has to outlive the call.
+    std::string extractNested(const uint8_t* bytes, size_t size, const std::string& name) {
+        SWFExtractor child(outputDir + "/" + name);
+        child.nestingDepth = nestingDepth + 1;
+        child.maxNestingDepth = maxNestingDepth;
+        child.maxNestedSize = maxNestedSize;
+        child.streaming = streaming;
+        child.jobs = jobs;
+        child.sharedPool = WorkStealingPool::current();
+        child.verbosity = verbosity == LOG_VERBOSE ? LOG_VERBOSE : LOG_QUIET;
+        child.onlyClasses = onlyClasses;
+        child.timeline.setKeyframeInterval(timeline.keyframeInterval());
+        if (!storeDir.empty()) {
+            child.storeDir = storeDir;
+            child.writer.setStore(storeDir + "/");
+        }
+        bool capturingHere = capturing && capturing->owner == this;
+        child.listingFiles = listingFiles || capturingHere;
+        if (packing) {
+            // Into the parent's pack as <name>/..., not a pack of its own
+            child.writer.forwardTo(writer);
+            child.packing = true;
+        }
+        if (!child.loadBytes(bytes, size)) {
+            logError("Embedded SWF ", name, " could not be loaded, kept as binary data only");
+            return "";
+        }
+        child.extract();
+        if (packing) removeDirectory(child.outputDir);   // Left empty
+        
+        // Lines of SWFs nested in the child already carry their "ns"
+        std::string prefix = "{\"ns\":\"" + JsonRecord::escape(name);
+        std::string lines;
+        for (auto& entry : child.manifest) {
+            std::stringstream records(entry.second);
+            std::string json;
+            while (std::getline(records, json)) {
+                lines += '\n';
+                if (json.compare(0, 7, "{\"ns\":\"") == 0) {
+                    lines += prefix + "/" + json.substr(7);
+                } else {
+                    lines += prefix + "\"," + json.substr(1);
+                }
+            }
+        }
+        if (child.listingFiles) {
+            // The cache entry of the outermost binary tag stays valid only while they all exist
+            child.outputFiles.push_back(child.outputDir + "/manifest.jsonl");
+            std::lock_guard<std::mutex> lock(stateMutex);
+            std::vector<std::string>& files = capturingHere ? capturing->files : outputFiles;
+            files.insert(files.end(), child.outputFiles.begin(), child.outputFiles.end());
+        }
+        nestedCount += 1 + child.nestedCount;
+        logInfo("Extracted embedded SWF: ", child.outputDir, " (", child.assetCount(), " assets, ",
+                child.frameCount(), " frames)");
+        return lines;
+    }
+    
+    void extractBinaryData(const uint8_t* binData, size_t binSize, int characterId) {
+        std::stringstream filename;
+        filename << outputDir << "/binary_" << characterId << ".bin";
+        std::string path = filename.str();
+        bool present;
+        std::string key = storeAsset("binary", {{binData, binSize}}, ".bin", path, present);
+        bool nested = isEmbeddedSwf(binData, binSize);
+        std::string nestedName = "binary_" + std::to_string(characterId);
+        
+        JsonRecord rec = assetRecord(characterId, "binary", path, binData, binSize);
+        if (!key.empty()) rec.add("hash", key);
+        if (nested) rec.add("swf", nestedName);
+        recordCharacter(characterId, path, "binary");
+        if (!present) {
+            writeInput(path, binData, binSize, OutputWriter::AssetInfo(characterId, "binary", rec.str()));
+            logTag("Extracted binary data: ", path, " (", binSize, " bytes)");
+        }
+        // One entry, so the embedded SWF's lines stay right after this one
+        addToManifest(binData, rec.str() + (nested ? extractNested(binData, binSize, nestedName) : ""));
+    }
+    
+    void extractSound(const uint8_t* soundData, size_t soundSize, int characterId, int format) {
+        std::stringstream filename;
+        const char* ext = ".raw";
+        if (format == 2) ext = ".mp3";
+        else if (format == 3) ext = ".raw";
+        
+        filename << outputDir << "/sound_" << characterId << ext;
+        std::string path = filename.str();
+        bool present;
+        std::string key = storeAsset("sound", {{soundData, soundSize}}, ext, path, present);
+        
+        JsonRecord rec = assetRecord(characterId, "sound", path, soundData, soundSize);
+        rec.add("soundFormat", format);
+        if (!key.empty()) rec.add("hash", key);
+        addToManifest(soundData, rec);
+        recordCharacter(characterId, path, "sound");
+        if (present) return;
+        
+        writeInput(path, soundData, soundSize, OutputWriter::AssetInfo(characterId, "sound", rec.str()));
+        logTag("Extracted sound: ", path, " (format=", format, ")");
+    }
+    
+    // DefineFont/DefineFont2/DefineFont3: writes font_N.svg, an SVG font
+    // with every glyph outline, and font_N.json with the code table,
+    // advances, bounds and kerning pairs. DefineFont has outlines only.
+    void extractFont(const uint8_t* payload, size_t size, uint16_t tagType) {
+        FontTables font;
+        if (!readFontTables(payload, size, tagType, font)) {
+            logError("Font ", font.characterId, " has a truncated offset table, skipped");
+            return;
+        }
+        uint16_t characterId = font.characterId;
+        uint32_t flags = font.flags;
+        bool layout = flags & 0x80;
+        const std::string& name = font.name;
+        size_t numGlyphs = font.numGlyphs;
+        const std::vector<uint16_t>& codes = font.codes;
+        
+        BitReader br(payload, size);
+        br.setBytePos(font.layoutStart);
+        auto u8 = [&br]() { br.alignByte(); return br.readBits(8); };
+        auto u16 = [&u8]() { uint32_t lo = u8(); return lo | (u8() << 8); };
+        auto si16 = [&u16]() { return (int16_t)u16(); };
+        std::vector<int16_t> advances;
+        std::vector<int32_t> bounds;
+        std::vector<int32_t> kerning;
+        int ascent = 0, descent = 0, leading = 0;
+        if (tagType != TAG_DEFINE_FONT) {
+            if (layout && !font.truncated) {
+                ascent = si16();
+                descent = si16();
+                leading = si16();
+                for (size_t i = 0; i < numGlyphs; i++) advances.push_back(si16());
+                for (size_t i = 0; i < numGlyphs; i++) {
+                    br.alignByte();
+                    int nBits = br.readBits(5);
+                    for (int k = 0; k < 4; k++) bounds.push_back(br.readSignedBits(nBits));
+                }
+                uint32_t kerningCount = u16();
+                for (uint32_t i = 0; i < kerningCount && !br.overran(); i++) {
+                    kerning.push_back(font.wideCodes ? u16() : u8());
+                    kerning.push_back(font.wideCodes ? u16() : u8());
+                    kerning.push_back(si16());
+                }
+            }
+            if (font.truncated || br.overran()) {
+                logError("Font ", characterId, " has a truncated code table or layout");
+                advances.clear();
+                bounds.clear();
+                kerning.clear();
+            }
+        }
+        
+        // DefineFont3 glyphs are drawn on a 20480 unit em square
+        int unitsPerEm = tagType == TAG_DEFINE_FONT3 ? 20480 : 1024;
+        std::string family = name.empty() ? "font_" + std::to_string(characterId) : name;
+        std::string svgPath = outputDir + "/font_" + std::to_string(characterId) + ".svg";
+        std::string tablePath = outputDir + "/font_" + std::to_string(characterId) + ".json";
+        bool present, tablePresent;
+        std::string key = storeAsset("font", {{payload, size}}, ".svg", svgPath, present);
+        storeAsset("font_table", {{payload, size}}, ".json", tablePath, tablePresent);
+        
+        JsonRecord rec = assetRecord(characterId, "font", svgPath, payload, size);
+        rec.add("table", relativePath(tablePath));
+        rec.add("name", name);
+        rec.add("glyphs", (uint64_t)numGlyphs);
+        rec.add("unitsPerEm", unitsPerEm);
+        rec.add("layout", layout);
+        rec.add("bold", (flags & 0x01) != 0);
+        rec.add("italic", (flags & 0x02) != 0);
+        if (!key.empty()) rec.add("hash", key);
+        trackOutput(tablePath);
+        addToManifest(payload, rec);
+        recordCharacter(characterId, svgPath, "font");
+        
+        // Codes are Unicode except in ShiftJIS and ANSI fonts before SWF 6
+        bool unicode = !codes.empty() && !(flags & 0x40) && (tagType == TAG_DEFINE_FONT3 || swfVersion >= 6 || !(flags & 0x10));
+        if (!tablePresent) {
+            JsonRecord table;
+            table.add("id", characterId);
+            table.add("name", name);
+            table.add("unitsPerEm", unitsPerEm);
+            table.add("unicode", unicode);
+            if (layout) {
+                table.add("ascent", ascent);
+                table.add("descent", descent);
+                table.add("leading", leading);
+            }
+            std::string glyphs = "[";
+            for (size_t i = 0; i < numGlyphs; i++) {
+                JsonRecord glyph;
+                glyph.add("index", (uint64_t)i);
+                if (i < codes.size()) glyph.add("code", codes[i]);
+                if (i < advances.size()) glyph.add("advance", advances[i]);
+                if (i * 4 + 3 < bounds.size()) {
+                    glyph.addRaw("bounds", "[" + std::to_string(bounds[i * 4]) + "," + std::to_string(bounds[i * 4 + 2]) + ","
+                                 + std::to_string(bounds[i * 4 + 1]) + "," + std::to_string(bounds[i * 4 + 3]) + "]");
+                }
+                if (i > 0) glyphs += ",";
+                glyphs += glyph.str();
+            }
+            table.addRaw("glyphs", glyphs + "]");
+            std::string pairs = "[";
+            for (size_t i = 0; i + 2 < kerning.size(); i += 3) {
+                JsonRecord pair;
+                pair.add("code1", kerning[i]);
+                pair.add("code2", kerning[i + 1]);
+                pair.add("adjustment", kerning[i + 2]);
+                if (i > 0) pairs += ",";
+                pairs += pair.str();
+            }
+            table.addRaw("kerning", pairs + "]");
+            writer.write(tablePath, table.str() + "\n", OutputWriter::AssetInfo(characterId, "font_table"));
+        }
+        if (present) return;
+        
+        std::vector<std::string> paths;
+        decodeGlyphs(payload + font.tableStart, font.offsets, paths);
+        
+        // Glyphs without an advance (no layout) get the em width
+        std::ostringstream svg;
+        svg << "<svg xmlns=\"http://www.w3.org/2000/svg\">\n<defs>\n";
+        svg << "<font id=\"font_" << characterId << "\" horiz-adv-x=\"" << unitsPerEm << "\">\n";
+        svg << "<font-face font-family=\"" << xmlEscape(family) << "\" units-per-em=\"" << unitsPerEm << "\"";
+        if (layout) svg << " ascent=\"" << ascent << "\" descent=\"" << -descent << "\"";
+        if (flags & 0x01) svg << " font-weight=\"bold\"";
+        if (flags & 0x02) svg << " font-style=\"italic\"";
+        svg << "/>\n<missing-glyph horiz-adv-x=\"" << unitsPerEm << "\"/>\n";
+        for (size_t i = 0; i < numGlyphs; i++) {
+            svg << "<glyph glyph-name=\"g" << i << "\"";
+            if (unicode && i < codes.size() && codes[i] >= 0x20) svg << " unicode=\"&#x" << std::hex << codes[i] << std::dec << ";\"";
+            svg << " horiz-adv-x=\"" << (i < advances.size() ? advances[i] : unitsPerEm) << "\"";
+            if (!paths[i].empty()) svg << " d=\"" << paths[i] << "\"";
+            svg << "/>\n";
+        }
+        if (unicode) {
+            // hkern narrows the pair, SWF adjustments widen it
+            for (size_t i = 0; i + 2 < kerning.size(); i += 3) {
+                svg << "<hkern u1=\"&#x" << std::hex << kerning[i] << ";\" u2=\"&#x" << kerning[i + 1] << std::dec
+                    << ";\" k=\"" << -kerning[i + 2] << "\"/>\n";
+            }
+        }
+        svg << "</font>\n</defs>\n</svg>\n";
+        writer.write(svgPath, svg.str(), OutputWriter::AssetInfo(characterId, "font", rec.str()));
+        logTag("Extracted font: ", svgPath, " (", family, ", ", numGlyphs, " glyphs)");
+    }
+    
+    // Builds a font's glyph index to code lookup once, as the font tag goes
+    // by in tag order, so texts can be decoded even when the font itself is
+    // filtered out or reused from the cache. DefineFont gets its codes from
+    // DefineFontInfo.
+    void loadFontCodes(uint16_t tagType, size_t pos, uint32_t tagLength) {
+        if (tagType == TAG_DEFINE_FONT || pos + tagLength > dataSize) return;
+        const uint8_t* payload = data + pos;
+        if (tagType == TAG_DEFINE_FONT2 || tagType == TAG_DEFINE_FONT3) {
+            FontTables font;
+            if (readFontTables(payload, tagLength, tagType, font)) fontCodes[font.characterId] = std::move(font.codes);
+            return;
+        }
+        
+        // DefineFontInfo/DefineFontInfo2: the codes fill the rest of the tag
+        if (tagLength < 4) return;
+        size_t at = 3 + payload[2];
+        if (at >= tagLength) return;
+        bool wideCodes = payload[at++] & 0x01;
+        if (tagType == TAG_DEFINE_FONT_INFO2) at++;   // Language code
+        std::vector<uint16_t>& codes = fontCodes[payload[0] | (payload[1] << 8)];
+        codes.clear();
+        for (; at + (wideCodes ? 1 : 0) < tagLength; at += wideCodes ? 2 : 1) {
+            codes.push_back(wideCodes ? (payload[at] | (payload[at + 1] << 8)) : payload[at]);
+        }
+    }
+    
+    static bool isFontTag(uint16_t tagType) {
+        return tagType == TAG_DEFINE_FONT || tagType == TAG_DEFINE_FONT2 || tagType == TAG_DEFINE_FONT3;
+    }
+    
+    // DefineText/DefineText2: maps each glyph index back through its font's
+    // code table. A record that moves to a new baseline starts a new line.
+    void extractText(const uint8_t* payload, size_t size, uint16_t tagType) {
+        if (size < 2) return;
+        BitReader br(payload, size);
+        auto u8 = [&br]() { br.alignByte(); return br.readBits(8); };
+        auto u16 = [&u8]() { uint32_t lo = u8(); return lo | (u8() << 8); };
+        
+        uint16_t characterId = u16();
+        br.alignByte();
+        int nBits = br.readBits(5);
+        for (int i = 0; i < 4; i++) br.readBits(nBits);   // Bounds
+        br.alignByte();
+        for (int part = 0; part < 3; part++) {
+            // Scale and rotate are optional, translate is not
+            if (part < 2 && !br.readBits(1)) continue;
+            nBits = br.readBits(5);
+            br.readBits(nBits);
+            br.readBits(nBits);
+        }
+        int glyphBits = u8();
+        int advanceBits = u8();
+        if (glyphBits > 32 || advanceBits > 32) {
+            logError("Text ", characterId, " has glyph fields wider than 32 bits, skipped");
+            return;
+        }
+        
+        std::string text;
+        std::vector<uint16_t> fonts;
+        const std::vector<uint16_t>* codes = nullptr;
+        size_t unresolved = 0;
+        bool hasLine = false;
+        int16_t lineY = 0;
+        while (!br.overran()) {
+            uint32_t flags = u8();
+            if (flags == 0 || br.overran()) break;
+            if (flags & 0x08) {
+                uint16_t fontId = u16();
+                auto it = fontCodes.find(fontId);
+                codes = it != fontCodes.end() ? &it->second : nullptr;
+                if (std::find(fonts.begin(), fonts.end(), fontId) == fonts.end()) fonts.push_back(fontId);
+            }
+            if (flags & 0x04) {
+                for (int i = 0; i < (tagType == TAG_DEFINE_TEXT2 ? 4 : 3); i++) u8();
+            }
+            if (flags & 0x01) u16();
+            if (flags & 0x02) {
+                int16_t y = (int16_t)u16();
+                if (hasLine && y != lineY) text += '\n';
+                hasLine = true;
+                lineY = y;
+            }
+            if (flags & 0x08) u16();        // Height
+            uint32_t glyphs = u8();
+            for (uint32_t i = 0; i < glyphs && !br.overran(); i++) {
+                uint32_t index = br.readBits(glyphBits);
+                br.readBits(advanceBits);
+                if (codes && index < codes->size()) {
+                    appendUtf8(text, (*codes)[index]);
+                } else {
+                    appendUtf8(text, 0xFFFD);
+                    unresolved++;
+                }
+            }
+        }
+        
+        std::string fontList = "[";
+        for (size_t i = 0; i < fonts.size(); i++) fontList += (i > 0 ? "," : "") + std::to_string(fonts[i]);
+        JsonRecord rec;
+        rec.add("id", characterId);
+        rec.add("type", "text");
+        rec.add("offset", inputOffset(payload));
+        rec.addRaw("fonts", fontList + "]");
+        if (unresolved > 0) rec.add("unresolved", (uint64_t)unresolved);
+        rec.add("text", text);
+        strings.push_back(std::make_pair(inputOffset(payload), rec.str()));
+        recordCharacter(characterId, outputDir + "/strings.jsonl", "text");
+    }
+    
+    // DefineEditText: the variable name and initial text, both stored as
+    // strings in the tag
+    void extractEditText(const uint8_t* payload, size_t size) {
+        if (size < 2) return;
+        BitReader br(payload, size);
+        auto u8 = [&br]() { br.alignByte(); return br.readBits(8); };
+        auto u16 = [&u8]() { uint32_t lo = u8(); return lo | (u8() << 8); };
+        auto str = [&u8, &br]() {
+            std::string out;
+            for (uint32_t c = u8(); c != 0 && !br.overran(); c = u8()) out += (char)c;
+            return out;
+        };
+        
+        uint16_t characterId = u16();
+        br.alignByte();
+        int nBits = br.readBits(5);
+        for (int i = 0; i < 4; i++) br.readBits(nBits);   // Bounds
+        uint32_t flags = u8();
+        uint32_t flags2 = u8();
+        JsonRecord rec;
+        rec.add("id", characterId);
+        rec.add("type", "edit_text");
+        rec.add("offset", inputOffset(payload));
+        if (flags & 0x01) rec.add("font", u16());
+        if (flags2 & 0x80) rec.add("fontClass", str());
+        if (flags & 0x01) u16();            // Height
+        if (flags & 0x04) {
+            for (int i = 0; i < 4; i++) u8();   // RGBA
+        }
+        if (flags & 0x02) u16();            // Max length
+        if (flags2 & 0x20) {
+            // Align, margins, indent, leading
+            u8();
+            for (int i = 0; i < 4; i++) u16();
+        }
+        rec.add("variable", str());
+        rec.add("html", (flags2 & 0x02) != 0);
+        rec.add("text", (flags & 0x80) ? str() : std::string());
+        if (br.overran()) rec.add("truncated", true);
+        strings.push_back(std::make_pair(inputOffset(payload), rec.str()));
+        recordCharacter(characterId, outputDir + "/strings.jsonl", "text");
+    }
+    
+    // SoundStreamHead/SoundStreamHead2: starts a stream on the current
+    // timeline, finishing the one it replaces
+    void beginSoundStream(const uint8_t* head, size_t size) {
+        if (size < 4) return;
+        finishSoundStream(timelineId);
+        SoundStream& s = soundStreams[timelineId];
+        s.index = soundStreamCount++;
+        s.timelineId = timelineId;
+        s.offset = inputOffset(head);
+        s.format = head[1] >> 4;
+        s.rate = SOUND_RATES[(head[1] >> 2) & 3];
+        s.bits = (s.format == 1 || (head[1] & 2)) ? 16 : 8;
+        s.channels = (head[1] & 1) ? 2 : 1;
+        if (s.isWav()) s.owned.resize(44);
+        logTag("Sound stream ", s.index, ": format=", s.format, ", ", s.rate, " Hz, ", s.channels, " channel(s)");
+    }
+    
+    // SoundStreamBlock: MP3 frames are referenced where they lie in the
+    // input and written with one gathered write at the end; ADPCM is
+    // decoded as it arrives. Streamed input is copied, since the window
+    // is reused for the next tag.
+    void addSoundStreamBlock(const uint8_t* block, size_t size) {
+        auto it = soundStreams.find(timelineId);
+        if (it == soundStreams.end()) return;
+        SoundStream& s = it->second;
+        if (s.format == 2) {
+            // Sample count and seek samples precede the frames
+            if (size < 4) return;
+            s.samples += block[0] | (block[1] << 8);
+            block += 4;
+            size -= 4;
+        }
+        if (size == 0) return;
+        s.blocks++;
+        if (s.format == 1) {
+            decodeAdpcm(block, size, s.channels, s.owned);
+        } else if (compressedBody) {
+            s.owned.insert(s.owned.end(), block, block + size);
+        } else {
+            s.segments.push_back(OutputWriter::Segment{block, size});
+        }
+    }
+    
+    // Writes the stream open on a timeline as sound_stream_N.mp3/.wav/.raw
+    void finishSoundStream(int32_t id) {
+        auto it = soundStreams.find(id);
+        if (it == soundStreams.end()) return;
+        SoundStream s = std::move(it->second);
+        soundStreams.erase(it);
+        
+        size_t headerSize = s.isWav() ? 44 : 0;
+        uint64_t audioBytes = s.owned.size() - headerSize;
+        for (const OutputWriter::Segment& seg : s.segments) audioBytes += seg.size;
+        if (audioBytes == 0) {
+            logTag("Sound stream ", s.index, " has no data, skipped");
+            return;
+        }
+        if (s.isWav()) {
+            std::vector<uint8_t> header = wavHeader(s.rate, s.channels, s.bits, (uint32_t)audioBytes);
+            std::copy(header.begin(), header.end(), s.owned.begin());
+        }
+        std::vector<OutputWriter::Segment> segments;
+        if (!s.owned.empty()) segments.push_back(OutputWriter::Segment{s.owned.data(), s.owned.size()});
+        segments.insert(segments.end(), s.segments.begin(), s.segments.end());
+        
+        const char* ext = s.format == 2 ? ".mp3" : s.isWav() ? ".wav" : ".raw";
+        std::string path = outputDir + "/sound_stream_" + std::to_string(s.index) + ext;
+        std::vector<std::pair<const uint8_t*, size_t>> parts;
+        for (const OutputWriter::Segment& seg : segments) parts.push_back(std::make_pair(seg.data, seg.size));
+        bool present;
+        std::string key = storeAsset("sound_stream", parts, ext, path, present);
+        
+        JsonRecord rec;
+        rec.add("type", "sound_stream");
+        rec.add("offset", s.offset);
+        rec.add("size", audioBytes);
+        rec.add("file", relativePath(path));
+        if (s.timelineId != MAIN_TIMELINE) rec.add("sprite", s.timelineId);
+        rec.add("soundFormat", s.format);
+        rec.add("rate", s.rate);
+        rec.add("channels", s.channels);
+        rec.add("blocks", (uint64_t)s.blocks);
+        if (s.format == 2) rec.add("samples", s.samples);
+        if (!key.empty()) rec.add("hash", key);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            manifest.push_back(std::make_pair(s.offset, rec.str()));
+            if (listingFiles) outputFiles.push_back(path);
+        }
+        if (present) return;
+        
+        writer.writeGather(path, std::move(segments), std::move(s.owned),
+                           OutputWriter::AssetInfo(-1, "sound_stream", rec.str()));
+        logTag("Extracted sound stream: ", path, " (", s.blocks, " blocks, ", audioBytes, " bytes)");
+    }
+    
+    void defineVideoStream(const uint8_t* payload, size_t size) {
+        if (size < 10) return;
+        uint16_t characterId = payload[0] | (payload[1] << 8);
+        VideoStream& v = videoStreams[characterId];
+        v = VideoStream();
+        v.offset = inputOffset(payload);
+        v.declaredFrames = payload[2] | (payload[3] << 8);
+        v.width = payload[4] | (payload[5] << 8);
+        v.height = payload[6] | (payload[7] << 8);
+        v.codec = payload[9];
+        logTag("Video stream ", characterId, ": codec=", v.codec, ", ", v.width, "x", v.height,
+               ", ", v.declaredFrames, " frames");
+    }
+    
+    // Frames are referenced where they lie in the input, like MP3 sound
+    // stream blocks, and copied only from the streaming window
+    void addVideoFrame(const uint8_t* payload, size_t size) {
+        if (size < 4) return;
+        auto it = videoStreams.find(payload[0] | (payload[1] << 8));
+        if (it == videoStreams.end()) return;
+        VideoStream& v = it->second;
+        VideoStream::Frame frame;
+        frame.number = payload[2] | (payload[3] << 8);
+        frame.size = size - 4;
+        frame.type = (uint8_t)videoFrameType(v.codec, payload + 4, frame.size);
+        if (compressedBody) {
+            frame.data = (const uint8_t*)(uintptr_t)v.owned.size();
+            v.owned.insert(v.owned.end(), payload + 4, payload + size);
+        } else {
+            frame.data = payload + 4;
+        }
+        v.frames.push_back(frame);
+    }
+    
+    // Writes video_N.flv: the FLV header, then per frame an 11-byte tag
+    // header and the VIDEODATA byte (plus VP6's size adjustment byte) ahead
+    // of the untouched payload. Only the headers are built here; the
+    // payloads are gathered from the input by the writer.
+    void finishVideoStream(uint16_t characterId, VideoStream& v) {
+        if (v.frames.empty()) return;
+        bool vp6 = v.codec == VIDEO_VP6 || v.codec == VIDEO_VP6_ALPHA;
+        size_t prefixSize = vp6 ? 2 : 1;
+        // Copied payloads, if any, stay at the front of the same buffer
+        std::vector<uint8_t> buffer = std::move(v.owned);
+        size_t copied = buffer.size();
+        buffer.resize(copied + 13 + v.frames.size() * (11 + prefixSize + 4));
+        uint8_t* h = buffer.data() + copied;
+        auto putBE = [](uint8_t* out, uint32_t value, int bytes) {
+            for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * (bytes - 1 - i)));
+        };
+        memcpy(h, "FLV\x01\x01", 5);          // Version 1, video only
+        putBE(h + 5, 9, 4);                 // Header size
+        putBE(h + 9, 0, 4);                 // PreviousTagSize0
+        
+        std::vector<OutputWriter::Segment> segments;
+        segments.push_back(OutputWriter::Segment{h, 13});
+        uint8_t* tag = h + 13;
+        uint64_t videoBytes = 0;
+        uint32_t fps = frameRate ? frameRate : 12 << 8;
+        for (const VideoStream::Frame& frame : v.frames) {
+            const uint8_t* bytes = compressedBody ? buffer.data() + (uintptr_t)frame.data : frame.data;
+            uint32_t dataSize = (uint32_t)(prefixSize + frame.size);
+            uint32_t timestamp = (uint32_t)((uint64_t)frame.number * 256000 / fps);
+            tag[0] = 9;                     // Video
+            putBE(tag + 1, dataSize, 3);
+            putBE(tag + 4, timestamp & 0xFFFFFF, 3);
+            tag[7] = (uint8_t)(timestamp >> 24);
+            putBE(tag + 8, 0, 3);           // StreamID
+            tag[11] = (uint8_t)((frame.type << 4) | v.codec);
+            if (vp6) tag[12] = 0;           // No horizontal or vertical crop
+            segments.push_back(OutputWriter::Segment{tag, 11 + prefixSize});
+            segments.push_back(OutputWriter::Segment{bytes, frame.size});
+            putBE(tag + 11 + prefixSize, 11 + dataSize, 4);
+            segments.push_back(OutputWriter::Segment{tag + 11 + prefixSize, 4});
+            tag += 11 + prefixSize + 4;
+            videoBytes += frame.size;
+        }
+        
+        std::string path = outputDir + "/video_" + std::to_string(characterId) + ".flv";
+        std::vector<std::pair<const uint8_t*, size_t>> parts;
+        for (const OutputWriter::Segment& seg : segments) parts.push_back(std::make_pair(seg.data, seg.size));
+        bool present;
+        std::string key = storeAsset("video", parts, ".flv", path, present);
+        
+        JsonRecord rec;
+        rec.add("id", characterId);
+        rec.add("type", "video");
+        rec.add("offset", v.offset);
+        rec.add("size", videoBytes);
+        rec.add("file", relativePath(path));
+        rec.add("codec", v.codec);
+        rec.add("width", v.width);
+        rec.add("height", v.height);
+        rec.add("frames", (uint64_t)v.frames.size());
+        if (!key.empty()) rec.add("hash", key);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            manifest.push_back(std::make_pair(v.offset, rec.str()));
+            if (listingFiles) outputFiles.push_back(path);
+        }
+        recordCharacter(characterId, path, "video");
+        if (present) return;
+        
+        writer.writeGather(path, std::move(segments), std::move(buffer),
+                           OutputWriter::AssetInfo(characterId, "video", rec.str()));
+        logTag("Extracted video: ", path, " (", v.frames.size(), " frames, ", videoBytes, " bytes)");
+    }
+    
+    void extractABC(const uint8_t* abcData, size_t abcSize, int abcIndex) {
+        std::stringstream filename;
+        filename << outputDir << "/abc_" << abcIndex << ".abc";
+        
+        // DoABC starts with 4 bytes of flags and a null-terminated name
+        std::string name;
+        for (size_t i = 4; i < abcSize && abcData[i] != 0; i++) {
+            name += (char)abcData[i];
+        }
+        std::string path = filename.str();
+        bool present;
+        std::string key = storeAsset("abc", {{abcData, abcSize}}, ".abc", path, present);
+        JsonRecord rec = assetRecord(-1, "abc", path, abcData, abcSize);
+        rec.add("index", abcIndex);
+        rec.add("name", name);
+        if (!key.empty()) rec.add("hash", key);
+        addToManifest(abcData, rec);
+        if (present) return;
+        
+        writeInput(path, abcData, abcSize, OutputWriter::AssetInfo(-1, "abc", rec.str()));
+        logTag("Extracted ABC bytecode: ", path);
+    }
+    
+    void extractActionScript(const uint8_t* scriptData, size_t scriptSize, int frameNum, int scriptNum, const std::string& context = "") {
+        std::stringstream filename;
+        if (context.empty()) {
+            filename << outputDir << "/frame_" << std::setw(4) << std::setfill('0') << frameNum 
+                     << "_action_" << scriptNum << ".as";
+        } else {
+            filename << outputDir << "/" << context << "_action_" << scriptNum << ".as";
+        }
+        
+        JsonRecord rec = assetRecord(-1, "action", filename.str(), scriptData, scriptSize);
+        rec.add("frame", frameNum);
+        if (!context.empty()) rec.add("context", context);
+        addToManifest(scriptData, rec);
+        
+        writeInput(filename.str(), scriptData, scriptSize, OutputWriter::AssetInfo(-1, "action", rec.str()));
+        
+        std::stringstream hexout;
+        for (size_t i = 0; i < scriptSize; i++) {
+            hexout << std::hex << std::setw(2) << std::setfill('0') << (int)scriptData[i] << " ";
+            if ((i + 1) % 16 == 0) hexout << "\n";
+        }
+        writer.write(filename.str() + ".hex", hexout.str(), OutputWriter::AssetInfo(-1, "action_hex"));
+        
+        logTag("Extracted ActionScript: ", filename.str(), " (", scriptSize, " bytes)");
+    }
+    
+    void saveFrameState(int frameNum) {
+        uint32_t ops = timeline.addFrame(displayList);
+        logTag("Saved frame state: frame ", frameNum, " (", displayList.size(), " objects, ", ops, " changes)");
+    }
+    
+    // Writes outputDir/timeline.swftl with the main timeline and every
+    // sprite's; see swf_timeline.h for the format
+    void writeTimeline() {
+        if (timeline.frameCount() == 0 && spriteTimelines.empty()) return;
+        std::string filename = outputDir + "/timeline.swftl";
+        
+        std::vector<std::pair<int32_t, const TimelineWriter*>> tracks;
+        tracks.push_back(std::make_pair(MAIN_TIMELINE, &timeline));
+        for (auto& pair : spriteTimelines) {
+            tracks.push_back(std::make_pair((int32_t)pair.first, &pair.second));
+        }
+        
+        JsonRecord rec;
+        rec.add("type", "timeline");
+        rec.add("frames", timeline.frameCount());
+        rec.add("keyframes", (uint64_t)timeline.keyframeOffsets().size());
+        rec.add("sprites", (uint64_t)spriteTimelines.size());
+        rec.add("file", relativePath(filename));
+        {
+            // Describes the whole tag stream, so it sorts after every tag
+            std::lock_guard<std::mutex> lock(stateMutex);
+            manifest.push_back(std::make_pair(UINT64_MAX, rec.str()));
+        }
+        
+        writer.write(filename, buildTimelineFile(tracks), OutputWriter::AssetInfo(-1, "timeline", rec.str()));
+    }
+    
+    // Every text of the movie in one strings.jsonl, in input order
+    void writeStrings() {
+        if (strings.empty()) return;
+        std::string filename = outputDir + "/strings.jsonl";
+        std::sort(strings.begin(), strings.end());
+        std::string out;
+        for (auto& entry : strings) {
+            out += entry.second;
+            out += '\n';
+        }
         
-        std::stringstream spriteContext;
-        spriteContext << "sprite_" << spriteId;
+        JsonRecord rec;
+        rec.add("type", "strings");
+        rec.add("texts", (uint64_t)strings.size());
+        rec.add("file", relativePath(filename));
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            manifest.push_back(std::make_pair(UINT64_MAX, rec.str()));
+        }
         
-        std::stringstream metafile;
-        metafile << outputDir << "/sprite_" << spriteId << "_info.txt";
-        std::ofstream meta(metafile.str());
+        writer.write(filename, out, OutputWriter::AssetInfo(-1, "strings", rec.str()));
+    }
+    
+    void logDisplayTag(uint16_t tagType, size_t tagStart, uint16_t depth, const DisplayList& list) {
+        if (verbosity < LOG_VERBOSE) return;
+        auto it = list.find(depth);
+        if (tagType == TAG_PLACE_OBJECT && it != list.end()) {
+            logTag("PlaceObject: char=", it->second.characterId, ", depth=", depth);
+        } else if (it != list.end()) {
+            const DisplayObject& obj = it->second;
+            logTag("PlaceObject", (tagType == TAG_PLACE_OBJECT3 ? "3" : "2"), 
+                   ": char=", obj.characterId, ", depth=", depth,
+                   (obj.name.empty() ? "" : ", name="), obj.name);
+        } else if (tagType == TAG_REMOVE_OBJECT) {
+            size_t p = tagStart;
+            logTag("RemoveObject: char=", readU16(p), ", depth=", depth);
+        } else {
+            logTag("RemoveObject2: depth=", depth);
+        }
+    }
+    
+    // Applies a PlaceObject or RemoveObject tag whose payload starts at
+    // pos to list. Returns the depth it changed.
+    uint16_t applyDisplayTag(uint16_t tagType, size_t pos, DisplayList& list) {
+        switch (tagType) {
+            case TAG_PLACE_OBJECT: {
+                uint16_t characterId = readU16(pos);
+                uint16_t depth = readU16(pos);
+                
+                BitReader br(&data[pos], dataSize - pos);
+                Matrix matrix = readMatrix(br);
+                
+                DisplayObject obj;
+                obj.characterId = characterId;
+                obj.depth = depth;
+                obj.matrix = matrix;
+                list[depth] = obj;
+                return depth;
+            }
+            
+            case TAG_PLACE_OBJECT2:
+            case TAG_PLACE_OBJECT3: {
+                uint8_t flags = readU8(pos);
+                // PlaceObject3 adds a second flags byte, and a class name after
+                // the depth when it names one or places an image by character
+                uint8_t flags2 = tagType == TAG_PLACE_OBJECT3 ? readU8(pos) : 0;
+                uint16_t depth = readU16(pos);
+                if ((flags2 & 0x08) || ((flags2 & 0x10) && (flags & 0x02))) readString(pos);
+                
+                DisplayObject obj;
+                auto it = list.find(depth);
+                if (it != list.end()) {
+                    obj = it->second;
+                }
+                obj.depth = depth;
+                
+                if (flags & 0x02) {
+                    obj.characterId = readU16(pos);
+                }
+                
+                if (flags & 0x04) {
+                    BitReader br(&data[pos], dataSize - pos);
+                    obj.matrix = readMatrix(br);
+                    br.alignByte();
+                    pos += br.getBytePos();
+                }
+                
+                if (flags & 0x08) {
+                    BitReader br(&data[pos], dataSize - pos);
+                    obj.colorTransform = readColorTransform(br, true);
+                    br.alignByte();
+                    pos += br.getBytePos();
+                }
+                
+                if (flags & 0x10) {
+                    readU16(pos);   // Ratio
+                }
+                
+                if (flags & 0x20) {
+                    obj.name = readString(pos);
+                }
+                
+                list[depth] = obj;
+                return depth;
+            }
+            
+            case TAG_REMOVE_OBJECT: {
+                readU16(pos);   // Character id
+                uint16_t depth = readU16(pos);
+                list.erase(depth);
+                return depth;
+            }
+            
+            default: {
+                uint16_t depth = readU16(pos);
+                list.erase(depth);
+                return depth;
+            }
+        }
+    }
+    
+    // Walks a sprite's tags into sprite. Only reads shared state and
+    // writes action files, so sprites can be walked on the pool side by side.
+    void walkSprite(uint16_t spriteId, size_t pos, size_t endPos, SpriteTrack& sprite) {
+        // A worker waiting inside a cached asset's nested task group can pick
+        // this walk up; its action files must not land in that asset's entry
+        CachedTag* outer = capturing;
+        capturing = nullptr;
+        logTag("Processing sprite ", spriteId, " contents...");
+        std::string context = "sprite_" + std::to_string(spriteId);
+        std::stringstream meta;
         meta << "Sprite ID: " << spriteId << "\n";
         meta << "Contains:\n";
+        sprite.timeline = TimelineWriter(timeline.keyframeInterval());
         
-        while (pos < endPos && pos < data.size()) {
+        while (pos < endPos && pos < dataSize) {
             uint16_t tagCodeAndLength = readU16(pos);
             uint16_t tagType = tagCodeAndLength >> 6;
             uint32_t tagLength = tagCodeAndLength & 0x3F;
@@ -396,32 +3763,94 @@ class SWFExtractor {
             
             switch (tagType) {
                 case TAG_SHOW_FRAME:
-                    spriteFrame++;
-                    meta << "  Frame " << spriteFrame << "\n";
+                    sprite.frames++;
+                    sprite.timeline.addFrame(sprite.list);
+                    meta << "  Frame " << sprite.frames << "\n";
                     break;
                     
                 case TAG_DO_ACTION: {
-                    if (pos + tagLength <= data.size()) {
-                        std::stringstream ctx;
-                        ctx << spriteContext.str() << "_frame_" << spriteFrame;
-                        extractActionScript(&data[pos], tagLength, spriteFrame, actionCount++, ctx.str());
+                    int actionIndex = sprite.actions++;
+                    if (pos + tagLength <= dataSize) {
+                        if (wanted(tagType, &data[pos], tagLength)) {
+                            std::stringstream ctx;
+                            ctx << context << "_frame_" << sprite.frames;
+                            extractActionScript(&data[pos], tagLength, sprite.frames, actionIndex, ctx.str());
+                        }
                         meta << "    Action script\n";
                     }
                     break;
                 }
                 
-                default:
-                    processTag(tagType, tagLength, pos);
-                    pos = tagStart + tagLength;
+                case TAG_PLACE_OBJECT:
+                case TAG_PLACE_OBJECT2:
+                case TAG_PLACE_OBJECT3:
+                case TAG_REMOVE_OBJECT:
+                case TAG_REMOVE_OBJECT2: {
+                    uint16_t depth = applyDisplayTag(tagType, pos, sprite.list);
+                    sprite.timeline.addTag(depth, tagType, tagLength, inputOffset(&data[tagStart]));
+                    logDisplayTag(tagType, tagStart, depth, sprite.list);
+                    break;
+                }
+                
+                default: {
+                    TagRecord rec;
+                    rec.type = tagType;
+                    rec.characterId = 0;
+                    rec.frame = sprite.frames;
+                    rec.length = tagLength;
+                    rec.offset = tagStart;
+                    sprite.deferred.push_back(rec);
                     break;
+                }
             }
             
             pos = tagStart + tagLength;
         }
+        sprite.meta = meta.str();
+        capturing = outer;
+    }
+    
+    // Adds a walked sprite to the movie: its timeline track, the tags it
+    // deferred, its manifest record and info file. Runs in input order.
+    void mergeSprite(uint16_t spriteId, const uint8_t* spriteData, size_t spriteSize, SpriteTrack& sprite) {
+        TimelineWriter& spriteTimeline = spriteTimelines[spriteId];
+        spriteTimeline = std::move(sprite.timeline);
+        DisplayList* parentStage = stage;
+        TimelineWriter* parentTrack = track;
+        int32_t parentTimelineId = timelineId;
+        stage = &sprite.list;
+        track = &spriteTimeline;
+        timelineId = spriteId;
+        
+        for (const TagRecord& rec : sprite.deferred) {
+            size_t pos = rec.offset;
+            if (filtering() && pos <= dataSize
+                    && !wanted(rec.type, &data[pos], std::min<size_t>(rec.length, dataSize - pos))) {
+                skipTag(rec.type);
+            } else {
+                processTag(rec.type, rec.length, pos);
+            }
+        }
+        finishSoundStream(spriteId);
+        stage = parentStage;
+        track = parentTrack;
+        timelineId = parentTimelineId;
+        
+        std::string metafile = outputDir + "/sprite_" + std::to_string(spriteId) + "_info.txt";
+        JsonRecord rec = assetRecord(spriteId, "sprite", metafile, spriteData, spriteSize);
+        rec.add("frames", sprite.frames);
+        rec.add("actions", sprite.actions);
+        addToManifest(spriteData, rec);
         
-        meta.close();
-        characterMap[spriteId] = metafile.str();
-        characterTypes[spriteId] = "sprite";
+        writer.write(metafile, sprite.meta, OutputWriter::AssetInfo(spriteId, "sprite", rec.str()));
+        recordCharacter(spriteId, metafile, "sprite");
+    }
+    
+    void processSprite(uint16_t spriteId, size_t& pos, size_t endPos) {
+        const uint8_t* spriteData = &data[pos];
+        SpriteTrack sprite;
+        walkSprite(spriteId, pos, endPos, sprite);
+        mergeSprite(spriteId, spriteData, endPos - pos, sprite);
     }
     
     void processTag(uint16_t tagType, uint32_t tagLength, size_t& pos) {
@@ -431,16 +3860,16 @@ class SWFExtractor {
             case TAG_SHOW_FRAME: {
                 currentFrame++;
                 globalFrame++;
-                std::cout << "\n=== Frame " << currentFrame << " ===" << std::endl;
+                logTag("\n=== Frame ", currentFrame, " ===");
                 saveFrameState(currentFrame);
                 break;
             }
             
             case TAG_JPEG_TABLES: {
                 jpegTables.clear();
-                if (pos + tagLength <= data.size()) {
-                    jpegTables.assign(data.begin() + pos, data.begin() + pos + tagLength);
-                    std::cout << "Loaded JPEG tables (" << tagLength << " bytes)" << std::endl;
+                if (pos + tagLength <= dataSize) {
+                    jpegTables.assign(data + pos, data + pos + tagLength);
+                    logTag("Loaded JPEG tables (", tagLength, " bytes)");
                 }
                 pos += tagLength;
                 break;
@@ -454,8 +3883,9 @@ class SWFExtractor {
                 int shapeVersion = (tagType == TAG_DEFINE_SHAPE) ? 1 :
                                   (tagType == TAG_DEFINE_SHAPE2) ? 2 :
                                   (tagType == TAG_DEFINE_SHAPE3) ? 3 : 4;
-                pos = tagStart;
-                extractShape(pos, tagLength, characterId, shapeVersion);
+                if (tagStart + tagLength <= dataSize) {
+                    extractShape(&data[tagStart], tagLength, characterId, shapeVersion);
+                }
                 pos = tagStart + tagLength;
                 break;
             }
@@ -465,13 +3895,18 @@ class SWFExtractor {
                 uint16_t characterId = readU16(pos);
                 std::stringstream filename;
                 filename << outputDir << "/morph_shape_" << characterId << ".dat";
-                std::ofstream out(filename.str(), std::ios::binary);
-                if (out.is_open()) {
-                    out.write((const char*)&data[tagStart], tagLength);
-                    out.close();
-                    std::cout << "Extracted morph shape: " << filename.str() << std::endl;
-                    characterMap[characterId] = filename.str();
-                    characterTypes[characterId] = "morph_shape";
+                if (tagStart + tagLength <= dataSize) {
+                    std::string path = filename.str();
+                    bool present;
+                    std::string key = storeAsset("morph_shape", {{&data[tagStart], tagLength}}, ".dat", path, present);
+                    if (!present) {
+                        writeInput(path, &data[tagStart], tagLength, OutputWriter::AssetInfo(characterId, "morph_shape"));
+                        logTag("Extracted morph shape: ", path);
+                    }
+                    JsonRecord rec = assetRecord(characterId, "morph_shape", path, &data[tagStart], tagLength);
+                    if (!key.empty()) rec.add("hash", key);
+                    addToManifest(&data[tagStart], rec);
+                    recordCharacter(characterId, path, "morph_shape");
                 }
                 pos = tagStart + tagLength;
                 break;
@@ -480,7 +3915,7 @@ class SWFExtractor {
             case TAG_DEFINE_BITS: {
                 uint16_t characterId = readU16(pos);
                 size_t imgSize = tagLength - 2;
-                if (pos + imgSize <= data.size()) {
+                if (pos + imgSize <= dataSize) {
                     extractJPEG(&data[pos], imgSize, characterId, true);
                     pos += imgSize;
                 }
@@ -490,7 +3925,7 @@ class SWFExtractor {
             case TAG_DEFINE_BITS_JPEG2: {
                 uint16_t characterId = readU16(pos);
                 size_t imgSize = tagLength - 2;
-                if (pos + imgSize <= data.size()) {
+                if (pos + imgSize <= dataSize) {
                     extractJPEG(&data[pos], imgSize, characterId, false);
                     pos += imgSize;
                 }
@@ -501,10 +3936,20 @@ class SWFExtractor {
             case TAG_DEFINE_BITS_JPEG4: {
                 uint16_t characterId = readU16(pos);
                 uint32_t alphaDataOffset = readU32(pos);
+                if (tagType == TAG_DEFINE_BITS_JPEG4) {
+                    readU16(pos);   // Deblocking filter parameter
+                }
                 size_t imgSize = alphaDataOffset;
-                if (pos + imgSize <= data.size()) {
+                size_t tagEnd = tagStart + tagLength;
+                if (pos + imgSize <= dataSize && pos + imgSize <= tagEnd) {
                     extractJPEG(&data[pos], imgSize, characterId, false);
-                    pos = tagStart + tagLength;
+                    // The alpha plane only applies to JPEG data, not embedded PNG/GIF
+                    bool isJpeg = imgSize > 2 && data[pos] == 0xFF && (data[pos+1] == 0xD8 || data[pos+1] == 0xD9);
+                    size_t alphaSize = tagEnd - (pos + imgSize);
+                    if (isJpeg && alphaSize > 0 && tagEnd <= dataSize) {
+                        extractAlphaMask(&data[pos], imgSize, &data[pos + imgSize], alphaSize, characterId);
+                    }
+                    pos = tagEnd;
                 }
                 break;
             }
@@ -516,26 +3961,17 @@ class SWFExtractor {
                 uint16_t width = readU16(pos);
                 uint16_t height = readU16(pos);
                 
-                size_t dataSize = tagLength - 7;
+                size_t bitmapSize = tagLength - 7;
                 uint8_t colorTableSize = 0;
                 if (format == 3) {
                     colorTableSize = readU8(pos);
-                    dataSize--;
+                    bitmapSize--;
                 }
                 
-                std::vector<uint8_t> decompressed;
-                if (pos + dataSize <= data.size()) {
-                    size_t estimatedSize = width * height * 4 + (colorTableSize + 1) * 4;
-                    decompressed.resize(estimatedSize);
-                    uLongf destLen = decompressed.size();
-                    int result = uncompress(decompressed.data(), &destLen, &data[pos], dataSize);
-                    if (result == Z_OK) {
-                        decompressed.resize(destLen);
-                        extractPNG(decompressed.data(), width, height, format, 
-                                  characterId, tagType == TAG_DEFINE_BITS_LOSSLESS2);
-                    } else {
-                        std::cerr << "Failed to decompress bitmap " << characterId << std::endl;
-                    }
+                bool hasAlpha = tagType == TAG_DEFINE_BITS_LOSSLESS2;
+                if (pos + bitmapSize <= dataSize) {
+                    extractPNG(&data[pos], bitmapSize, width, height, format, colorTableSize,
+                               characterId, hasAlpha, &data[tagStart], tagLength);
                 }
                 pos = tagStart + tagLength;
                 break;
@@ -545,7 +3981,7 @@ class SWFExtractor {
                 uint16_t characterId = readU16(pos);
                 uint32_t reserved = readU32(pos);
                 size_t binSize = tagLength - 6;
-                if (pos + binSize <= data.size()) {
+                if (pos + binSize <= dataSize) {
                     extractBinaryData(&data[pos], binSize, characterId);
                     pos += binSize;
                 }
@@ -559,16 +3995,60 @@ class SWFExtractor {
                 uint8_t flags = readU8(pos);
                 uint32_t sampleCount = readU32(pos);
                 size_t soundSize = tagLength - 7;
-                if (pos + soundSize <= data.size()) {
+                if (pos + soundSize <= dataSize) {
                     extractSound(&data[pos], soundSize, characterId, soundFormat);
                     pos += soundSize;
                 }
                 break;
             }
             
+            case TAG_SOUND_STREAM_HEAD:
+            case TAG_SOUND_STREAM_HEAD2:
+                if (pos + tagLength <= dataSize) beginSoundStream(&data[pos], tagLength);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_SOUND_STREAM_BLOCK:
+                if (pos + tagLength <= dataSize) addSoundStreamBlock(&data[pos], tagLength);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_DEFINE_FONT:
+            case TAG_DEFINE_FONT2:
+            case TAG_DEFINE_FONT3:
+                if (pos + tagLength <= dataSize) extractFont(&data[pos], tagLength, tagType);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_DEFINE_FONT_INFO:
+            case TAG_DEFINE_FONT_INFO2:
+                loadFontCodes(tagType, pos, tagLength);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_DEFINE_TEXT:
+            case TAG_DEFINE_TEXT2:
+                if (pos + tagLength <= dataSize) extractText(&data[pos], tagLength, tagType);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_DEFINE_EDIT_TEXT:
+                if (pos + tagLength <= dataSize) extractEditText(&data[pos], tagLength);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_DEFINE_VIDEO_STREAM:
+                if (pos + tagLength <= dataSize) defineVideoStream(&data[pos], tagLength);
+                pos = tagStart + tagLength;
+                break;
+                
+            case TAG_VIDEO_FRAME:
+                if (pos + tagLength <= dataSize) addVideoFrame(&data[pos], tagLength);
+                pos = tagStart + tagLength;
+                break;
+            
             case TAG_DO_ACTION: {
-                static int actionCount = 0;
-                if (pos + tagLength <= data.size()) {
+                if (pos + tagLength <= dataSize) {
                     extractActionScript(&data[pos], tagLength, currentFrame, actionCount++);
                     pos += tagLength;
                 }
@@ -576,16 +4056,8 @@ class SWFExtractor {
             }
             
             case TAG_DO_ABC: {
-                static int abcCount = 0;
-                if (pos + tagLength <= data.size()) {
-                    std::stringstream filename;
-                    filename << outputDir << "/abc_" << abcCount++ << ".abc";
-                    std::ofstream out(filename.str(), std::ios::binary);
-                    if (out.is_open()) {
-                        out.write((const char*)&data[pos], tagLength);
-                        out.close();
-                        std::cout << "Extracted ABC bytecode: " << filename.str() << std::endl;
-                    }
+                if (pos + tagLength <= dataSize) {
+                    extractABC(&data[pos], tagLength, abcCount++);
                     pos += tagLength;
                 }
                 break;
@@ -593,186 +4065,603 @@ class SWFExtractor {
             
             case TAG_SYMBOL_CLASS: {
                 uint16_t numSymbols = readU16(pos);
-                std::cout << "SymbolClass with " << numSymbols << " symbols:" << std::endl;
+                logTag("SymbolClass with ", numSymbols, " symbols:");
                 
                 std::stringstream filename;
                 filename << outputDir << "/symbol_class.txt";
-                std::ofstream out(filename.str());
+                std::stringstream out;
                 
                 for (int i = 0; i < numSymbols; i++) {
                     uint16_t tagId = readU16(pos);
                     std::string name = readString(pos);
-                    std::cout << "  Symbol " << tagId << " = " << name << std::endl;
+                    logTag("  Symbol ", tagId, " = ", name);
                     out << tagId << "\t" << name << "\n";
+                    
+                    JsonRecord rec;
+                    rec.add("id", tagId);
+                    rec.add("type", "symbol");
+                    rec.add("name", name);
+                    rec.add("file", relativePath(filename.str()));
+                    addToManifest(&data[tagStart], rec);
                 }
-                out.close();
+                writer.write(filename.str(), out.str(), OutputWriter::AssetInfo(-1, "symbol_class"));
                 break;
             }
             
-            case TAG_PLACE_OBJECT: {
-                uint16_t characterId = readU16(pos);
-                uint16_t depth = readU16(pos);
-                
-                BitReader br(&data[pos], data.size() - pos);
-                Matrix matrix = readMatrix(br);
-                br.alignByte();
-                
-                DisplayObject obj;
-                obj.characterId = characterId;
-                obj.depth = depth;
-                obj.matrix = matrix;
-                displayList[depth] = obj;
-                
-                std::cout << "PlaceObject: char=" << characterId << ", depth=" << depth << std::endl;
+            case TAG_PLACE_OBJECT:
+            case TAG_PLACE_OBJECT2:
+            case TAG_PLACE_OBJECT3:
+            case TAG_REMOVE_OBJECT:
+            case TAG_REMOVE_OBJECT2: {
+                uint16_t depth = applyDisplayTag(tagType, pos, *stage);
+                track->addTag(depth, tagType, tagLength, inputOffset(&data[tagStart]));
+                logDisplayTag(tagType, tagStart, depth, *stage);
                 pos = tagStart + tagLength;
                 break;
             }
             
-            case TAG_PLACE_OBJECT2:
-            case TAG_PLACE_OBJECT3: {
-                uint8_t flags = readU8(pos);
-                uint16_t depth = readU16(pos);
-                
-                DisplayObject obj;
-                if (displayList.count(depth)) {
-                    obj = displayList[depth];
-                }
-                obj.depth = depth;
-                
-                if (flags & 0x02) {
-                    obj.characterId = readU16(pos);
-                }
-                
-                if (flags & 0x04) {
-                    BitReader br(&data[pos], data.size() - pos);
-                    obj.matrix = readMatrix(br);
-                    br.alignByte();
-                    pos = tagStart + (br.getBytePos() - (tagStart - pos));
-                }
-                
-                if (flags & 0x08) {
-                    BitReader br(&data[pos], data.size() - pos);
-                    obj.colorTransform = readColorTransform(br, tagType == TAG_PLACE_OBJECT3);
-                    br.alignByte();
-                    pos = tagStart + (br.getBytePos() - (tagStart - pos));
-                }
-                
-                if (flags & 0x20) {
-                    obj.name = readString(pos);
-                }
-                
-                displayList[depth] = obj;
-                
-                std::cout << "PlaceObject" << (tagType == TAG_PLACE_OBJECT3 ? "3" : "2") 
-                         << ": char=" << obj.characterId << ", depth=" << depth;
-                if (!obj.name.empty()) std::cout << ", name=" << obj.name;
-                std::cout << std::endl;
+            case TAG_DEFINE_SPRITE: {
+                uint16_t spriteId = readU16(pos);
+                uint16_t frameCount = readU16(pos);
+                logTag("\nSprite ", spriteId, " with ", frameCount, " frames");
                 
+                size_t spriteEnd = tagStart + tagLength;
+                processSprite(spriteId, pos, spriteEnd);
+                pos = spriteEnd;
+                break;
+            }
+            
+            default:
                 pos = tagStart + tagLength;
                 break;
+        }
+    }
+    
+public:
+    SWFExtractor(const std::string& outDir) : data(nullptr), dataSize(0), outputDir(outDir), currentFrame(0), globalFrame(0),
+                                              stage(&displayList), track(&timeline),
+                                              streaming(false), compression('F'), compressedBody(nullptr), compressedSize(0),
+                                              uncompressedSize(0), swfVersion(0), jobs(1), sharedPool(nullptr), packing(false), verbosity(LOG_NORMAL),
+                                              dataBase(0), storeHits(0), incremental(false), unchanged(false),
+                                              cacheHits(0), filterIds(false), withDependencies(false), skippedTags(0),
+                                              nestingDepth(0), maxNestingDepth(4), maxNestedSize(256ull << 20), nestedCount(0),
+                                              soundStreamCount(0), frameRate(0), timelineId(MAIN_TIMELINE), listingFiles(false),
+                                              actionCount(0), abcCount(0) {
+        createDirectory(outputDir);
+    }
+    
+    bool loadSWF(const std::string& filename) {
+        if (!input.open(filename)) {
+            std::cerr << "Failed to open file: " << filename << std::endl;
+            return false;
+        }
+        if (input.size() < 8) {
+            std::cerr << "File too small to be a SWF: " << filename << std::endl;
+            return false;
+        }
+        if (caching() && checkCache(filename)) {
+            logInfo("Unchanged since the last run: ", filename);
+            unchanged = true;
+            return true;
+        }
+        return loadBytes(input.data(), input.size());
+    }
+    
+    // Loads a SWF that is already in memory, such as one embedded in
+    // another. FWS bytes are parsed in place, so they must outlive extract().
+    bool loadBytes(const uint8_t* header, size_t size) {
+        uint8_t version = header[3];
+        swfVersion = version;
+        uint32_t fileLength = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+        
+        logInfo("SWF Version: ", (int)version);
+        logInfo("File Length: ", fileLength);
+        
+        if (fileLength < 8) {
+            std::cerr << "Invalid file length in header!" << std::endl;
+            return false;
+        }
+        
+        const uint8_t* body = header + 8;
+        size_t bodySize = size - 8;
+        compression = header[0];
+        uncompressedSize = fileLength - 8;
+        
+        if ((header[0] == 'C' || header[0] == 'Z') && streaming) {
+            // Decoded incrementally by extract()
+            compressedBody = body;
+            compressedSize = bodySize;
+        } else if (header[0] == 'Z') {
+            logInfo("Decompressing LZMA SWF...");
+            LzmaSource source(body, bodySize, uncompressedSize);
+            inflated.resize(uncompressedSize);
+            size_t total = 0;
+            while (total < inflated.size()) {
+                size_t got = source.read(inflated.data() + total, inflated.size() - total);
+                if (got == 0) break;
+                total += got;
+            }
+            if (source.failed()) {
+                std::cerr << "Decompression failed!" << std::endl;
+                return false;
+            }
+            inflated.resize(total);
+            input.close();
+            data = inflated.data();
+            dataSize = inflated.size();
+        } else if (header[0] == 'C') {
+            logInfo("Decompressing SWF...");
+            inflated.resize(fileLength - 8);
+            uLongf destLen = inflated.size();
+            int result = uncompress(inflated.data(), &destLen, body, bodySize);
+            if (result != Z_OK) {
+                std::cerr << "Decompression failed!" << std::endl;
+                return false;
+            }
+            inflated.resize(destLen);
+            input.close();
+            data = inflated.data();
+            dataSize = inflated.size();
+        } else if (header[0] == 'F') {
+            // Parse straight out of the mapping
+            data = body;
+            dataSize = std::min<size_t>(bodySize, fileLength - 8);
+        } else {
+            std::cerr << "Unknown SWF format!" << std::endl;
+            return false;
+        }
+        
+        return true;
+    }
+    
+    // Decode and process tags as they become available instead of
+    // decompressing the whole body up front. Only CWS/ZWS input benefits;
+    // uncompressed files are already parsed in place.
+    void setStreaming(bool enabled) { streaming = enabled; }
+    
+    static const char* tagName(uint16_t tagType) {
+        switch (tagType) {
+            case TAG_END: return "End";
+            case TAG_SHOW_FRAME: return "ShowFrame";
+            case TAG_DEFINE_SHAPE: return "DefineShape";
+            case TAG_PLACE_OBJECT: return "PlaceObject";
+            case TAG_REMOVE_OBJECT: return "RemoveObject";
+            case TAG_DEFINE_BITS: return "DefineBits";
+            case TAG_DEFINE_BUTTON: return "DefineButton";
+            case TAG_JPEG_TABLES: return "JPEGTables";
+            case TAG_DEFINE_FONT: return "DefineFont";
+            case TAG_DEFINE_TEXT: return "DefineText";
+            case TAG_DEFINE_FONT_INFO: return "DefineFontInfo";
+            case TAG_DO_ACTION: return "DoAction";
+            case TAG_DEFINE_SOUND: return "DefineSound";
+            case TAG_SOUND_STREAM_HEAD: return "SoundStreamHead";
+            case TAG_SOUND_STREAM_BLOCK: return "SoundStreamBlock";
+            case TAG_SOUND_STREAM_HEAD2: return "SoundStreamHead2";
+            case TAG_DEFINE_BITS_LOSSLESS: return "DefineBitsLossless";
+            case TAG_DEFINE_BITS_JPEG2: return "DefineBitsJPEG2";
+            case TAG_DEFINE_SHAPE2: return "DefineShape2";
+            case TAG_PLACE_OBJECT2: return "PlaceObject2";
+            case TAG_REMOVE_OBJECT2: return "RemoveObject2";
+            case TAG_DEFINE_SHAPE3: return "DefineShape3";
+            case TAG_DEFINE_TEXT2: return "DefineText2";
+            case TAG_DEFINE_BUTTON2: return "DefineButton2";
+            case TAG_DEFINE_BITS_JPEG3: return "DefineBitsJPEG3";
+            case TAG_DEFINE_BITS_LOSSLESS2: return "DefineBitsLossless2";
+            case TAG_DEFINE_EDIT_TEXT: return "DefineEditText";
+            case TAG_DEFINE_SPRITE: return "DefineSprite";
+            case TAG_DEFINE_MORPH_SHAPE: return "DefineMorphShape";
+            case TAG_DEFINE_FONT2: return "DefineFont2";
+            case TAG_EXPORT_ASSETS: return "ExportAssets";
+            case TAG_DEFINE_FONT_INFO2: return "DefineFontInfo2";
+            case TAG_FILE_ATTRIBUTES: return "FileAttributes";
+            case TAG_PLACE_OBJECT3: return "PlaceObject3";
+            case TAG_DEFINE_FONT3: return "DefineFont3";
+            case TAG_SYMBOL_CLASS: return "SymbolClass";
+            case TAG_DO_ABC: return "DoABC";
+            case TAG_DEFINE_SHAPE4: return "DefineShape4";
+            case TAG_DEFINE_MORPH_SHAPE2: return "DefineMorphShape2";
+            case TAG_DEFINE_BINARY_DATA: return "DefineBinaryData";
+            case TAG_DEFINE_BITS_JPEG4: return "DefineBitsJPEG4";
+            case TAG_DEFINE_VIDEO_STREAM: return "DefineVideoStream";
+            case TAG_VIDEO_FRAME: return "VideoFrame";
+            default: return nullptr;
+        }
+    }
+    
+    // Summarizes a SWF as one JSON object without decoding any tag body:
+    // header fields, frame and character counts, assets per class, DoABC
+    // sizes and a count and byte total per tag type. Uncompressed files
+    // are walked in place; compressed ones are inflated a chunk at a time
+    // and skipped through, so memory use stays at one chunk.
+    static bool inspect(const std::string& filename, std::string& summary) {
+        MappedFile input;
+        if (!input.open(filename) || input.size() < 8) {
+            std::cerr << "Failed to open SWF: " << filename << std::endl;
+            return false;
+        }
+        const uint8_t* header = input.data();
+        char signature = (char)header[0];
+        if (header[1] != 'W' || header[2] != 'S' || (signature != 'F' && signature != 'C' && signature != 'Z')) {
+            std::cerr << "Not a SWF file: " << filename << std::endl;
+            return false;
+        }
+        uint32_t fileLength = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+        const uint8_t* body = header + 8;
+        size_t bodySize = input.size() - 8;
+        
+        std::unique_ptr<ChunkSource> source;
+        if (signature == 'Z') {
+            source.reset(new LzmaSource(body, bodySize, fileLength >= 8 ? fileLength - 8 : 0));
+        } else if (signature == 'C') {
+            source.reset(new ZlibSource(body, bodySize));
+        }
+        std::unique_ptr<StreamWindow> window;
+        const uint8_t* p = body;
+        size_t available = std::min<size_t>(bodySize, fileLength >= 8 ? fileLength - 8 : 0);
+        if (source) {
+            window.reset(new StreamWindow(*source));
+            window->fill(21);
+            p = window->current();
+            available = window->available();
+        }
+        
+        // RECT, then frame rate and count
+        BitReader br(p, available);
+        int nBits = br.readBits(5);
+        for (int i = 0; i < 4; i++) br.readSignedBits(nBits);
+        br.alignByte();
+        size_t pos = br.getBytePos();
+        if (pos + 4 > available) {
+            std::cerr << "Truncated SWF header: " << filename << std::endl;
+            return false;
+        }
+        uint16_t frameRate = p[pos] | (p[pos + 1] << 8);
+        uint16_t frameCount = p[pos + 2] | (p[pos + 3] << 8);
+        pos += 4;
+        if (window) {
+            window->consume(pos);
+            pos = 0;
+        }
+        
+        struct TagTotal {
+            uint64_t count;
+            uint64_t bytes;
+        };
+        std::map<uint16_t, TagTotal> tags;
+        std::map<std::string, uint64_t> assets;
+        std::string abcBlocks;
+        uint64_t abcBytes = 0, abcCount = 0;
+        uint64_t frames = 0, characters = 0, tagCount = 0;
+        bool truncated = true;
+        
+        while (true) {
+            // Header and up to 64 bytes of payload, enough for DoABC names
+            const uint8_t* tag;
+            size_t have;
+            if (window) {
+                window->fill(6 + 64);
+                tag = window->current();
+                have = window->available();
+            } else {
+                tag = p + pos;
+                have = available - pos;
             }
-            
-            case TAG_REMOVE_OBJECT: {
-                uint16_t characterId = readU16(pos);
-                uint16_t depth = readU16(pos);
-                displayList.erase(depth);
-                std::cout << "RemoveObject: char=" << characterId << ", depth=" << depth << std::endl;
-                break;
+            if (have < 2) break;
+            uint16_t tagCodeAndLength = tag[0] | (tag[1] << 8);
+            uint16_t tagType = tagCodeAndLength >> 6;
+            uint64_t tagLength = tagCodeAndLength & 0x3F;
+            size_t headerLength = 2;
+            if (tagLength == 0x3F) {
+                if (have < 6) break;
+                tagLength = tag[2] | (tag[3] << 8) | (tag[4] << 16) | ((uint32_t)tag[5] << 24);
+                headerLength = 6;
             }
-            
-            case TAG_REMOVE_OBJECT2: {
-                uint16_t depth = readU16(pos);
-                displayList.erase(depth);
-                std::cout << "RemoveObject2: depth=" << depth << std::endl;
+            if (tagType == TAG_END) {
+                truncated = false;
                 break;
             }
             
-            case TAG_DEFINE_SPRITE: {
-                uint16_t spriteId = readU16(pos);
-                uint16_t frameCount = readU16(pos);
-                std::cout << "\nSprite " << spriteId << " with " << frameCount << " frames" << std::endl;
-                
-                size_t spriteEnd = tagStart + tagLength;
-                processSprite(spriteId, pos, spriteEnd);
-                pos = spriteEnd;
-                break;
+            tagCount++;
+            tags[tagType].count++;
+            tags[tagType].bytes += tagLength;
+            if (tagType == TAG_SHOW_FRAME) frames++;
+            if (definesCharacter(tagType)) characters++;
+            const char* cls = tagClass(tagType);
+            if (cls && tagType != TAG_SOUND_STREAM_BLOCK && tagType != TAG_VIDEO_FRAME) assets[cls]++;
+            if (tagType == TAG_DO_ABC) {
+                // Flags, then the block name
+                std::string name;
+                for (size_t i = headerLength + 4; i < have && i < headerLength + tagLength && tag[i] != 0; i++) {
+                    name += (char)tag[i];
+                }
+                JsonRecord block;
+                block.add("name", name);
+                block.add("size", tagLength);
+                abcBlocks += (abcCount ? "," : "") + block.str();
+                abcBytes += tagLength;
+                abcCount++;
             }
             
-            default:
-                pos = tagStart + tagLength;
-                break;
+            if (window) {
+                window->consume(headerLength);
+                if (!window->skip(tagLength)) break;
+            } else {
+                if (tagLength > available - pos - headerLength) break;
+                pos += headerLength + tagLength;
+            }
+        }
+        if (window && window->failed()) truncated = true;
+        
+        JsonRecord rec;
+        rec.add("file", filename);
+        rec.add("signature", std::string(1, signature) + "WS");
+        rec.add("version", (int)header[3]);
+        rec.add("fileSize", (uint64_t)input.size());
+        rec.add("length", fileLength);
+        rec.add("frameRate", frameRate / 256.0);
+        rec.add("frameCount", frameCount);
+        rec.add("frames", frames);
+        rec.add("tagCount", tagCount);
+        rec.add("characters", characters);
+        rec.add("truncated", truncated);
+        
+        JsonRecord assetCounts;
+        for (auto& pair : assets) assetCounts.add(pair.first.c_str(), pair.second);
+        rec.addRaw("assets", assetCounts.str());
+        
+        JsonRecord abc;
+        abc.add("count", abcCount);
+        abc.add("bytes", abcBytes);
+        abc.addRaw("blocks", "[" + abcBlocks + "]");
+        rec.addRaw("abc", abc.str());
+        
+        std::string tagList;
+        for (auto& pair : tags) {
+            JsonRecord t;
+            t.add("code", pair.first);
+            const char* name = tagName(pair.first);
+            t.add("name", name ? name : "Unknown");
+            t.add("count", pair.second.count);
+            t.add("bytes", pair.second.bytes);
+            tagList += (tagList.empty() ? "" : ",") + t.str();
         }
+        rec.addRaw("tags", "[" + tagList + "]");
+        summary = rec.str();
+        return true;
     }
     
-public:
-    SWFExtractor(const std::string& outDir) : outputDir(outDir), currentFrame(0), globalFrame(0) {
-        createDirectory(outputDir);
+    // Appends every output file to outputDir/assets.swfpack instead of
+    // writing loose files. Must be called before extract().
+    bool setPackOutput() {
+        std::string packPath = outputDir + "/assets.swfpack";
+        if (!writer.openPack(packPath, outputDir + "/")) {
+            std::cerr << "Failed to create pack file: " << packPath << std::endl;
+            return false;
+        }
+        packing = true;
+        return true;
     }
     
-    bool loadSWF(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Failed to open file: " << filename << std::endl;
+    // Shares assets between runs through a content-addressed store at dir:
+    // each asset is written once, as dir/<xx>/<hash><ext>, and manifests
+    // of later runs point at the existing file
+    bool setStore(const std::string& dir) {
+        createDirectory(dir);
+        static const char hex[] = "0123456789abcdef";
+        for (int i = 0; i < 256; i++) {
+            createDirectory(dir + "/" + hex[i >> 4] + hex[i & 15]);
+        }
+        struct stat st;
+        if (stat((dir + "/ff").c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            std::cerr << "Failed to create asset store: " << dir << std::endl;
             return false;
         }
+        storeDir = dir;
+        writer.setStore(dir + "/");
+        return true;
+    }
+    
+    void setVerbosity(int level) { verbosity = level; }
+    
+    // Keeps extract.cache in the output directory so that a later run
+    // skips an unchanged SWF and re-extracts only asset tags whose payload
+    // changed. Has no effect with --pack, which rewrites the whole pack.
+    void setIncremental(bool enabled) { incremental = enabled; }
+    
+    bool isUnchanged() const { return unchanged; }
+    
+    // Extracts only the named output classes (shape, morph_shape, image,
+    // binary, sound, abc, action); other asset tags are skipped unread
+    void setClassFilter(const std::set<std::string>& classes) { onlyClasses = classes; }
+    
+    // Extracts only these characters, by id or by SymbolClass/ExportAssets
+    // name, and with dependencies also every character they use, directly
+    // or not. Both need the whole tag stream, so they disable streaming.
+    void setCharacterFilter(const std::set<int>& ids, const std::set<std::string>& symbols, bool dependencies) {
+        onlyIds = ids;
+        onlySymbols = symbols;
+        filterIds = !ids.empty() || !symbols.empty();
+        withDependencies = filterIds && dependencies;
+        if (!symbols.empty() || withDependencies) streaming = false;
+    }
+    
+    static bool isAssetClass(const std::string& name) {
+        static const char* const classes[] = {"shape", "morph_shape", "image", "binary", "sound", "video", "font", "text", "abc", "action"};
+        for (const char* c : classes) {
+            if (name == c) return true;
+        }
+        return false;
+    }
+    
+    // SWFs found in DefineBinaryData are extracted into a directory named
+    // after the tag, up to depth levels deep and when their declared
+    // length is at most maxBytes; others are only dumped as .bin files
+    void setNesting(int depth, uint64_t maxBytes) {
+        maxNestingDepth = depth;
+        maxNestedSize = maxBytes;
+    }
+    
+    // Frames between full display-list snapshots in timeline.swftl
+    void setKeyframeInterval(unsigned frames) { timeline.setKeyframeInterval(frames); }
+    
+    // Worker threads used for asset extraction; 1 keeps everything on
+    // the calling thread. Streaming always runs serially.
+    void setJobs(unsigned count) { jobs = std::max(1u, count); }
+    
+    // Runs asset jobs on pool instead of a private one; used by batch mode
+    // so every SWF shares the same threads
+    void setPool(WorkStealingPool* pool) { sharedPool = pool; }
+    
+    size_t assetCount() {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        return characterMap.size();
+    }
+    
+    int frameCount() const { return currentFrame; }
+    
+    // Loads the timeline.swftl (or assets.swfpack) a previous run left in
+    // the output directory, for displayListAt()
+    bool loadTimelineIndex() {
+        PackReader pack;
+        if (pack.open(outputDir + "/assets.swfpack")) {
+            const PackEntry* entry = pack.find("timeline.swftl");
+            std::vector<uint8_t> bytes;
+            return entry && pack.read(*entry, bytes) && timelineIndex.load(std::move(bytes));
+        }
+        return timelineIndex.open(outputDir + "/timeline.swftl");
+    }
+    
+    // Display list of the main timeline (timelineId = MAIN_TIMELINE) or a
+    // sprite at frame, counted from 1. Starts from the nearest keyframe
+    // snapshot and replays only the PlaceObject/RemoveObject tags after
+    // it, so the cost is bounded by the keyframe interval rather than the
+    // frame number. Needs loadSWF() without streaming.
+    bool displayListAt(int32_t timelineId, uint32_t frame, DisplayList& list) {
+        std::vector<TimelineTag> tags;
+        if (!data || !timelineIndex.seek(timelineId, frame, list, tags)) return false;
+        for (const TimelineTag& tag : tags) {
+            if (tag.offset < 8 || tag.offset - 8 + tag.length > dataSize) return false;
+            applyDisplayTag(tag.type, tag.offset - 8, list);
+        }
+        return true;
+    }
+    
+    void extract() {
+        if (unchanged) {
+            writer.flush();
+            return;
+        }
+        if (compressedBody) {
+            extractStreaming();
+            return;
+        }
         
-        char signature[3];
-        file.read(signature, 3);
-        
-        uint8_t version;
-        file.read((char*)&version, 1);
-        
-        uint32_t fileLength;
-        file.read((char*)&fileLength, 4);
-        
-        std::cout << "SWF Version: " << (int)version << std::endl;
-        std::cout << "File Length: " << fileLength << std::endl;
+        size_t pos = readMovieHeader();
+        if (!onlySymbols.empty() || withDependencies) scanCharacters(pos);
         
-        std::vector<uint8_t> fileData;
-        fileData.resize(fileLength - 8);
-        file.read((char*)fileData.data(), fileData.size());
-        file.close();
+        if (jobs > 1 || sharedPool) {
+            buildTagIndex(pos);
+            extractParallel();
+            printSummary();
+            return;
+        }
         
-        if (signature[0] == 'C') {
-            std::cout << "Decompressing SWF..." << std::endl;
-            data.resize(fileLength - 8);
-            uLongf destLen = data.size();
-            int result = uncompress(data.data(), &destLen, fileData.data(), fileData.size());
-            if (result != Z_OK) {
-                std::cerr << "Decompression failed!" << std::endl;
-                return false;
+        while (pos < dataSize) {
+            uint16_t tagCodeAndLength = readU16(pos);
+            uint16_t tagType = tagCodeAndLength >> 6;
+            uint32_t tagLength = tagCodeAndLength & 0x3F;
+            
+            if (tagLength == 0x3F) {
+                tagLength = readU32(pos);
             }
-            data.resize(destLen);
-        } else if (signature[0] == 'F') {
-            data = fileData;
-        } else {
-            std::cerr << "Unknown SWF format!" << std::endl;
-            return false;
+            
+            if (tagType == TAG_END) break;
+            
+            if (isFontTag(tagType)) loadFontCodes(tagType, pos, tagLength);
+            processTagCached(tagType, tagLength, pos);
         }
         
-        return true;
+        printSummary();
     }
     
-    void extract() {
-        size_t pos = 0;
-        
-        BitReader br(data.data(), data.size());
+private:
+    // Parses the frame rect, rate and count, returns the offset of the first tag
+    size_t readMovieHeader() {
+        BitReader br(data, dataSize);
         int nBits = br.readBits(5);
         br.readSignedBits(nBits);
         br.readSignedBits(nBits);
         br.readSignedBits(nBits);
         br.readSignedBits(nBits);
         br.alignByte();
-        pos = br.getBytePos();
+        size_t pos = br.getBytePos();
         
-        uint16_t frameRate = readU16(pos);
+        frameRate = readU16(pos);
         uint16_t frameCount = readU16(pos);
         
-        std::cout << "Frame Rate: " << (frameRate / 256.0) << " fps" << std::endl;
-        std::cout << "Frame Count: " << frameCount << std::endl;
-        std::cout << "\n=== Processing Tags ===" << std::endl;
+        JsonRecord rec;
+        rec.add("type", "swf");
+        rec.add("signature", std::string(1, compression) + "WS");
+        rec.add("version", swfVersion);
+        rec.add("length", (uint64_t)uncompressedSize + 8);
+        rec.add("frameRate", frameRate / 256.0);
+        rec.add("frameCount", frameCount);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            manifest.push_back(std::make_pair(0, rec.str()));
+        }
+        
+        logInfo("Frame Rate: ", (frameRate / 256.0), " fps");
+        logInfo("Frame Count: ", frameCount);
+        logTag("\n=== Processing Tags ===");
+        return pos;
+    }
+    
+    // Tags whose output depends only on their own payload (and, for
+    // DefineBits, the JPEG tables) and can be extracted in any order
+    static bool isAssetTag(uint16_t tagType) {
+        switch (tagType) {
+            case TAG_DEFINE_SHAPE:
+            case TAG_DEFINE_SHAPE2:
+            case TAG_DEFINE_SHAPE3:
+            case TAG_DEFINE_SHAPE4:
+            case TAG_DEFINE_MORPH_SHAPE:
+            case TAG_DEFINE_MORPH_SHAPE2:
+            case TAG_DEFINE_BITS:
+            case TAG_DEFINE_BITS_JPEG2:
+            case TAG_DEFINE_BITS_JPEG3:
+            case TAG_DEFINE_BITS_JPEG4:
+            case TAG_DEFINE_BITS_LOSSLESS:
+            case TAG_DEFINE_BITS_LOSSLESS2:
+            case TAG_DEFINE_BINARY_DATA:
+            case TAG_DEFINE_SOUND:
+            case TAG_DEFINE_FONT:
+            case TAG_DEFINE_FONT2:
+            case TAG_DEFINE_FONT3:
+            case TAG_DO_ABC:
+                return true;
+            default:
+                return false;
+        }
+    }
+    
+    static bool definesCharacter(uint16_t tagType) {
+        return (isAssetTag(tagType) && tagType != TAG_DO_ABC)
+            || tagType == TAG_DEFINE_SPRITE
+            || tagType == TAG_DEFINE_BUTTON
+            || tagType == TAG_DEFINE_BUTTON2
+            || tagType == TAG_DEFINE_TEXT
+            || tagType == TAG_DEFINE_TEXT2
+            || tagType == TAG_DEFINE_EDIT_TEXT
+            || tagType == TAG_DEFINE_VIDEO_STREAM;
+    }
+    
+    // First pass: walk the top-level tag headers only
+    void buildTagIndex(size_t pos) {
+        tagIndex.clear();
+        uint32_t frame = 0;
         
-        while (pos < data.size()) {
+        while (pos < dataSize) {
             uint16_t tagCodeAndLength = readU16(pos);
             uint16_t tagType = tagCodeAndLength >> 6;
             uint32_t tagLength = tagCodeAndLength & 0x3F;
@@ -781,15 +4670,200 @@ public:
                 tagLength = readU32(pos);
             }
             
+            if (tagType == TAG_END) break;
+            if (pos + tagLength > dataSize) {
+                tagLength = (uint32_t)(dataSize - pos);
+            }
+            
+            TagRecord rec;
+            rec.type = tagType;
+            rec.characterId = 0;
+            rec.frame = frame;
+            rec.length = tagLength;
+            rec.offset = pos;
+            if (definesCharacter(tagType) && tagLength >= 2) {
+                rec.characterId = data[pos] | (data[pos+1] << 8);
+            }
+            tagIndex.push_back(rec);
+            
+            if (tagType == TAG_SHOW_FRAME) frame++;
+            pos += tagLength;
+        }
+    }
+    
+    // Second pass: asset tags go to the pool, then the timeline is
+    // replayed in order once every asset has been written, so frame
+    // dumps see the same characterMap as a serial run
+    void extractParallel() {
+        std::unique_ptr<WorkStealingPool> ownPool;
+        if (!sharedPool) ownPool.reset(new WorkStealingPool(jobs));
+        TaskGroup assets(sharedPool ? *sharedPool : *ownPool);
+        
+        // Sprite bodies are walked alongside the assets, each into its own
+        // track, and merged in input order by the second loop
+        std::map<size_t, SpriteTrack> sprites;
+        for (size_t i = 0; i < tagIndex.size(); i++) {
+            if (tagIndex[i].type == TAG_DEFINE_SPRITE && tagIndex[i].length >= 4) sprites[i];
+        }
+        for (auto& pair : sprites) {
+            const TagRecord* tag = &tagIndex[pair.first];
+            SpriteTrack* sprite = &pair.second;
+            assets.run([this, tag, sprite]() {
+                walkSprite(tag->characterId, tag->offset + 4, tag->offset + tag->length, *sprite);
+            });
+        }
+        
+        for (const TagRecord& rec : tagIndex) {
+            if (isAssetTag(rec.type) && !wanted(rec.type, data + rec.offset, rec.length)) {
+                skipTag(rec.type);
+                continue;
+            }
+            if (rec.type == TAG_JPEG_TABLES) {
+                // Pending DefineBits jobs must see the tables they were queued under
+                assets.wait();
+                size_t pos = rec.offset;
+                processTag(rec.type, rec.length, pos);
+            } else if (rec.type == TAG_DO_ABC) {
+                int abcIndex = abcCount++;
+                const uint8_t* abcData = data + rec.offset;
+                size_t abcSize = rec.length;
+                assets.run([this, abcData, abcSize, abcIndex]() {
+                    extractCached(TAG_DO_ABC, abcData, abcSize, abcIndex, [&]() {
+                        extractABC(abcData, abcSize, abcIndex);
+                    });
+                });
+            } else if (isAssetTag(rec.type)) {
+                const TagRecord* tag = &rec;
+                assets.run([this, tag]() {
+                    size_t pos = tag->offset;
+                    processTagCached(tag->type, tag->length, pos);
+                });
+            }
+        }
+        assets.wait();
+        
+        for (size_t i = 0; i < tagIndex.size(); i++) {
+            const TagRecord& rec = tagIndex[i];
+            if (isFontTag(rec.type)) loadFontCodes(rec.type, rec.offset, rec.length);
+            if (isAssetTag(rec.type) || rec.type == TAG_JPEG_TABLES) continue;
+            auto sprite = sprites.find(i);
+            if (sprite != sprites.end()) {
+                mergeSprite(rec.characterId, data + rec.offset + 4, rec.length - 4, sprite->second);
+                sprites.erase(sprite);
+                continue;
+            }
+            size_t pos = rec.offset;
+            processTagCached(rec.type, rec.length, pos);
+        }
+    }
+    
+    void extractStreaming() {
+        std::unique_ptr<ChunkSource> source;
+        if (compression == 'Z') {
+            source.reset(new LzmaSource(compressedBody, compressedSize, uncompressedSize));
+        } else {
+            source.reset(new ZlibSource(compressedBody, compressedSize));
+        }
+        StreamWindow window(*source);
+        
+        // RECT is at most 17 bytes, followed by rate and count
+        window.fill(21);
+        data = window.current();
+        dataSize = window.available();
+        size_t headerSize = readMovieHeader();
+        window.consume(headerSize);
+        
+        while (true) {
+            if (!window.fill(2)) break;
+            const uint8_t* hdr = window.current();
+            uint16_t tagCodeAndLength = hdr[0] | (hdr[1] << 8);
+            uint16_t tagType = tagCodeAndLength >> 6;
+            uint32_t tagLength = tagCodeAndLength & 0x3F;
+            size_t headerLength = 2;
+            
+            if (tagLength == 0x3F) {
+                if (!window.fill(6)) break;
+                hdr = window.current();
+                tagLength = hdr[2] | (hdr[3] << 8) | (hdr[4] << 16) | ((uint32_t)hdr[5] << 24);
+                headerLength = 6;
+            }
+            
             if (tagType == TAG_END) break;
             
-            processTag(tagType, tagLength, pos);
+            // Fonts are read in full even when filtered out, for their code tables
+            if (filtering() && tagClass(tagType) && !isFontTag(tagType)) {
+                window.fill(headerLength + std::min<size_t>(tagLength, 2));
+                size_t got = std::min<size_t>(window.available() - headerLength, tagLength);
+                if (!wanted(tagType, window.current() + headerLength, got)) {
+                    skipTag(tagType);
+                    window.consume(headerLength);
+                    if (!window.skip(tagLength)) {
+                        std::cerr << "Stream ended inside tag " << tagType << " at offset "
+                                  << window.offset() << ", stopping" << std::endl;
+                        break;
+                    }
+                    continue;
+                }
+            }
+            
+            if (!window.fill(headerLength + (size_t)tagLength)) {
+                std::cerr << "Stream ended inside tag " << tagType << " at offset "
+                          << window.offset() << ", stopping" << std::endl;
+                break;
+            }
+            
+            // Present just this tag to processTag
+            dataBase = window.offset();
+            data = window.current();
+            dataSize = headerLength + tagLength;
+            size_t pos = headerLength;
+            if (isFontTag(tagType)) loadFontCodes(tagType, pos, tagLength);
+            processTagCached(tagType, tagLength, pos);
+            window.consume(dataSize);
+        }
+        
+        if (window.failed()) {
+            std::cerr << "Warning: compressed stream is truncated or corrupt" << std::endl;
+        }
+        logInfo("Peak window size: ", window.capacity(), " bytes");
+        data = nullptr;
+        dataSize = 0;
+        dataBase = 0;
+        
+        printSummary();
+    }
+    
+    // One JSON object per line, in input order
+    void writeManifest() {
+        std::sort(manifest.begin(), manifest.end());
+        std::string out;
+        for (auto& entry : manifest) {
+            out += entry.second;
+            out += '\n';
+        }
+        writer.write(outputDir + "/manifest.jsonl", out, OutputWriter::AssetInfo(-1, "manifest"));
+    }
+    
+    void printSummary() {
+        while (!soundStreams.empty()) finishSoundStream(soundStreams.begin()->first);
+        for (auto& pair : videoStreams) finishVideoStream(pair.first, pair.second);
+        videoStreams.clear();
+        writeTimeline();
+        writeStrings();
+        writeManifest();
+        if (packing) {
+            if (!writer.closePack()) {
+                std::cerr << "Failed to finish pack index" << std::endl;
+            }
+        } else {
+            writer.flush();
         }
+        if (caching()) saveCache();
         
-        std::cout << "\n=== Extraction Summary ===" << std::endl;
-        std::cout << "Total frames: " << currentFrame << std::endl;
-        std::cout << "Total assets extracted: " << characterMap.size() << std::endl;
-        std::cout << "\nAsset breakdown:" << std::endl;
+        logInfo("\n=== Extraction Summary ===");
+        logInfo("Total frames: ", currentFrame);
+        logInfo("Total assets extracted: ", characterMap.size());
+        logInfo("\nAsset breakdown:");
         
         std::map<std::string, int> typeCounts;
         for (auto& pair : characterTypes) {
@@ -797,24 +4871,446 @@ public:
         }
         
         for (auto& pair : typeCounts) {
-            std::cout << "  " << pair.first << ": " << pair.second << std::endl;
+            logInfo("  ", pair.first, ": ", pair.second);
+        }
+        if (!storeDir.empty()) {
+            logInfo("\nAsset store: ", writer.storedFiles(), " files added, ", storeHits.load(), " already stored");
+        }
+        if (caching()) {
+            logInfo("Unchanged asset tags reused: ", cacheHits.load());
+        }
+        if (filtering()) {
+            logInfo("Tags skipped by filter: ", skippedTags.load());
+        }
+        if (nestedCount > 0) {
+            logInfo("Embedded SWFs extracted: ", nestedCount.load());
+        }
+        std::cout.flush();
+        
+        if (writer.failures() > 0) {
+            std::cerr << "Warning: " << writer.failures() << " output files could not be written" << std::endl;
+        }
+    }
+};
+
+thread_local CachedTag* SWFExtractor::capturing = nullptr;
+
+// ==========================================
+// Batch mode
+// ==========================================
+
+// Rough peak memory for extracting one SWF: the mapped file plus the
+// decompressed body unless it is streamed
+static uint64_t estimateMemory(const std::string& path, bool streaming) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    uint64_t fileSize = (uint64_t)st.st_size;
+    
+    uint8_t header[8] = {0};
+    std::ifstream in(path, std::ios::binary);
+    in.read((char*)header, sizeof(header));
+    uint32_t fileLength = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+    if ((header[0] == 'C' || header[0] == 'Z') && !streaming) {
+        return fileSize + fileLength;
+    }
+    return fileSize;
+}
+
+static uint64_t defaultMemoryBudget() {
+#ifndef _WIN32
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0) return (uint64_t)pages * pageSize / 2;
+#endif
+    return 2ULL << 30;
+}
+
+static bool hasSwfExtension(const std::string& name) {
+    if (name.size() < 4) return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".swf";
+}
+
+// Inputs are every *.swf in a directory, or the paths listed one per line
+// in a text file (blank lines and lines starting with # are skipped)
+static bool collectBatchInputs(const std::string& source, std::vector<std::string>& files) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) {
+        std::cerr << "Failed to open batch input: " << source << std::endl;
+        return false;
+    }
+    
+    if (S_ISDIR(st.st_mode)) {
+#ifdef _WIN32
+        std::cerr << "Batch directories are not supported on Windows; pass a file list" << std::endl;
+        return false;
+#else
+        DIR* dir = opendir(source.c_str());
+        if (!dir) {
+            std::cerr << "Failed to read directory: " << source << std::endl;
+            return false;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (hasSwfExtension(name)) files.push_back(source + "/" + name);
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+#endif
+    } else {
+        std::ifstream list(source);
+        std::string line;
+        while (std::getline(list, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            files.push_back(line);
         }
     }
+    return true;
+}
+
+struct BatchItem {
+    std::string input;
+    std::string outputDir;
+    uint64_t cost;                   // Estimated peak memory
 };
 
+// Extracts many SWFs in one process. Files and their asset jobs share one
+// work-stealing pool; a file is admitted only when its estimated memory
+// fits the budget, largest first, with smaller files filling the gaps.
+// Each SWF goes to outputRoot/<name without .swf>.
+static int runBatch(const std::string& source, const std::string& outputRoot, unsigned jobs,
+                    uint64_t budgetBytes, bool streaming, int verbosity,
+                    const std::function<bool(SWFExtractor&)>& configure) {
+    std::vector<std::string> files;
+    if (!collectBatchInputs(source, files)) return 1;
+    if (files.empty()) {
+        std::cerr << "No SWF files in " << source << std::endl;
+        return 1;
+    }
+    
+    #ifdef _WIN32
+    _mkdir(outputRoot.c_str());
+    #else
+    mkdir(outputRoot.c_str(), 0755);
+    #endif
+    
+    std::vector<BatchItem> pending;
+    std::map<std::string, int> names;
+    for (const std::string& file : files) {
+        size_t slash = file.find_last_of("/\\");
+        std::string name = file.substr(slash == std::string::npos ? 0 : slash + 1);
+        if (hasSwfExtension(name)) name.resize(name.size() - 4);
+        int seen = names[name]++;
+        if (seen > 0) name += "_" + std::to_string(seen + 1);
+        pending.push_back(BatchItem{file, outputRoot + "/" + name, estimateMemory(file, streaming)});
+    }
+    std::stable_sort(pending.begin(), pending.end(), [](const BatchItem& a, const BatchItem& b) {
+        return a.cost > b.cost;
+    });
+    std::vector<uint64_t> costs;
+    for (const BatchItem& item : pending) costs.push_back(item.cost);
+    
+    jobs = std::max(1u, jobs);
+    WorkStealingPool pool(jobs);
+    MemoryBudget budget(budgetBytes, jobs);
+    std::mutex consoleMutex;
+    std::atomic<size_t> done(0), failed(0);
+    size_t total = pending.size();
+    
+    {
+        TaskGroup group(pool);
+        while (!pending.empty()) {
+            size_t index = budget.acquireFirstFit(costs);
+            BatchItem item = pending[index];
+            pending.erase(pending.begin() + index);
+            costs.erase(costs.begin() + index);
+            
+            group.run([&, item]() {
+                bool ok = false;
+                bool unchanged = false;
+                size_t assets = 0;
+                int frames = 0;
+                {
+                    SWFExtractor extractor(item.outputDir);
+                    ok = configure(extractor);
+                    extractor.setVerbosity(verbosity == LOG_VERBOSE ? LOG_VERBOSE : LOG_QUIET);
+                    extractor.setJobs(jobs);
+                    if (jobs > 1) extractor.setPool(&pool);
+                    if (ok) ok = extractor.loadSWF(item.input);
+                    if (ok) {
+                        extractor.extract();
+                        unchanged = extractor.isUnchanged();
+                        assets = extractor.assetCount();
+                        frames = extractor.frameCount();
+                    }
+                }
+                budget.release(item.cost);
+                
+                size_t n = ++done;
+                if (!ok) failed++;
+                if (verbosity >= LOG_NORMAL) {
+                    std::lock_guard<std::mutex> lock(consoleMutex);
+                    std::cout << "[" << n << "/" << total << "] " << item.input;
+                    if (ok && unchanged) {
+                        std::cout << " unchanged";
+                    } else if (ok) {
+                        std::cout << " -> " << item.outputDir << " (" << assets << " assets, " << frames << " frames)";
+                    } else {
+                        std::cout << " failed";
+                    }
+                    std::cout << std::endl;
+                }
+            });
+        }
+    }
+    
+    if (verbosity >= LOG_NORMAL) {
+        std::cout << "Extracted " << (total - failed) << " of " << total << " SWF files" << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Parses a whole decimal option value within [min, max]
+static bool parseOptionNumber(const char* text, long long min, long long max, long long& value) {
+    char* end;
+    errno = 0;
+    long long parsed = std::strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < min || parsed > max) return false;
+    value = parsed;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cout << "Usage: " << argv[0] << " <input.swf> <output_directory>" << std::endl;
+    bool streaming = false;
+    bool pack = false;
+    bool batch = false;
+    bool inspect = false;
+    bool incremental = false;
+    std::set<std::string> onlyClasses;
+    std::set<int> onlyIds;
+    std::set<std::string> onlySymbols;
+    bool withDependencies = false;
+    int nestedDepth = 4;
+    uint64_t nestedMaxSize = 256ull << 20;
+    uint64_t memoryBudget = defaultMemoryBudget();
+    std::string storeDir;
+    int verbosity = LOG_NORMAL;
+    unsigned jobs = std::thread::hardware_concurrency();
+    unsigned keyframeInterval = 64;
+    uint32_t seekFrame = 0;
+    int32_t seekSprite = MAIN_TIMELINE;
+    std::vector<std::string> args;
+    long long value;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            streaming = true;
+        } else if (arg == "--quiet" || arg == "-q") {
+            verbosity = LOG_QUIET;
+        } else if (arg == "--verbose" || arg == "-v") {
+            verbosity = LOG_VERBOSE;
+        } else if (arg == "--pack") {
+            pack = true;
+        } else if (arg == "--store" && i + 1 < argc) {
+            storeDir = argv[++i];
+        } else if (arg == "--only" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                if (!SWFExtractor::isAssetClass(name)) {
+                    std::cerr << "Unknown asset class: " << name << std::endl;
+                    return 1;
+                }
+                onlyClasses.insert(name);
+            }
+        } else if (arg == "--id" && i + 1 < argc) {
+            // Comma-separated ids and first-last ranges
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                size_t dash = item.find('-');
+                int first = std::atoi(item.c_str());
+                int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+                for (int id = first; id <= last && id <= 0xFFFF; id++) onlyIds.insert(id);
+            }
+        } else if (arg == "--symbol" && i + 1 < argc) {
+            onlySymbols.insert(argv[++i]);
+        } else if (arg == "--with-deps") {
+            withDependencies = true;
+        } else if (arg == "--nested-depth" && i + 1 < argc) {
+            if (!parseOptionNumber(argv[++i], 0, INT_MAX, value)) {
+                std::cerr << "Invalid depth for --nested-depth: " << argv[i] << std::endl;
+                return 1;
+            }
+            nestedDepth = (int)value;
+        } else if (arg == "--nested-max-size" && i + 1 < argc) {
+            // Megabytes, kept small enough to convert to bytes
+            if (!parseOptionNumber(argv[++i], 0, LLONG_MAX >> 20, value)) {
+                std::cerr << "Invalid size for --nested-max-size: " << argv[i] << std::endl;
+                return 1;
+            }
+            nestedMaxSize = (uint64_t)value << 20;
+        } else if (arg == "--incremental") {
+            incremental = true;
+        } else if (arg == "--inspect") {
+            inspect = true;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            if (!parseOptionNumber(argv[++i], 1, LLONG_MAX >> 20, value)) {
+                std::cerr << "Invalid size for --memory-budget: " << argv[i] << std::endl;
+                return 1;
+            }
+            memoryBudget = (uint64_t)value << 20;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            // More threads than this only adds contention
+            const long long MAX_JOBS = 1024;
+            if (!parseOptionNumber(argv[++i], 1, LLONG_MAX, value)) {
+                std::cerr << "Invalid thread count for --jobs: " << argv[i] << std::endl;
+                return 1;
+            }
+            jobs = (unsigned)std::min(value, MAX_JOBS);
+        } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+            if (!parseOptionNumber(argv[++i], 1, UINT32_MAX, value)) {
+                std::cerr << "Invalid frame count for --keyframe-interval: " << argv[i] << std::endl;
+                return 1;
+            }
+            keyframeInterval = (unsigned)value;
+        } else if (arg == "--frame" && i + 1 < argc) {
+            seekFrame = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sprite" && i + 1 < argc) {
+            seekSprite = std::atoi(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    
+    if (inspect && !args.empty()) {
+        // One JSON line per file; nothing is written to disk
+        std::vector<std::string> files;
+        if (batch) {
+            for (const std::string& source : args) {
+                if (!collectBatchInputs(source, files)) return 1;
+            }
+        } else {
+            files = args;
+        }
+        int failures = 0;
+        for (const std::string& file : files) {
+            std::string summary;
+            if (SWFExtractor::inspect(file, summary)) {
+                std::cout << summary << "\n";
+            } else {
+                failures++;
+            }
+        }
+        std::cout.flush();
+        return failures == 0 ? 0 : 1;
+    }
+    
+    if (args.size() != 2) {
+        std::cout << "Usage: " << argv[0] << " [options] <input.swf> <output_directory>" << std::endl;
+        std::cout << "       " << argv[0] << " [options] --batch <directory|list.txt> <output_root>" << std::endl;
+        std::cout << "       " << argv[0] << " --inspect [--batch] <input.swf|directory|list.txt> ..." << std::endl;
+        std::cout << "  -q, --quiet            Print errors only" << std::endl;
+        std::cout << "  -v, --verbose          Print one line per tag" << std::endl;
+        std::cout << "  --stream               Decode compressed (CWS/ZWS) SWFs incrementally, processing each tag as it arrives" << std::endl;
+        std::cout << "  --jobs N               Extract assets on N threads (default: one per core, 1 = serial)" << std::endl;
+        std::cout << "  --pack                 Write all assets into output_directory/assets.swfpack (see swf_pack)" << std::endl;
+        std::cout << "  --store DIR            Write assets once into the content-addressed store DIR, shared" << std::endl;
+        std::cout << "                         between runs; manifest.jsonl points at the stored files" << std::endl;
+        std::cout << "  --only CLASSES         Extract only these comma-separated classes: shape, morph_shape," << std::endl;
+        std::cout << "                         image, binary, sound, video, font, text, abc, action; other tags are skipped unread" << std::endl;
+        std::cout << "  --id IDS               Extract only these characters, e.g. 12,40-45" << std::endl;
+        std::cout << "  --symbol NAME          Extract only the character exported as NAME (repeatable)" << std::endl;
+        std::cout << "  --with-deps            With --id/--symbol, also extract every character they use: placed" << std::endl;
+        std::cout << "                         children, bitmap fills and fonts, recursively" << std::endl;
+        std::cout << "  --nested-depth N       Extract SWFs embedded in DefineBinaryData into binary_<id>/, up to" << std::endl;
+        std::cout << "                         N levels deep (default: 4, 0 = only dump them as .bin)" << std::endl;
+        std::cout << "  --nested-max-size MB   Leave embedded SWFs larger than MB uncompressed as .bin only (default: 256)" << std::endl;
+        std::cout << "  --incremental          Skip an unchanged SWF and re-extract only changed asset tags, using" << std::endl;
+        std::cout << "                         output_directory/extract.cache from the previous run" << std::endl;
+        std::cout << "  --keyframe-interval N  Store a full display list every N frames in timeline.swftl (default: 64)" << std::endl;
+        std::cout << "  --frame N              Print the display list at frame N using the timeline.swftl" << std::endl;
+        std::cout << "                         from an earlier run in output_directory; extracts nothing" << std::endl;
+        std::cout << "  --sprite ID            With --frame, use the timeline of sprite ID" << std::endl;
+        std::cout << "  --batch                Extract every SWF in a directory or listed in a file, one per line," << std::endl;
+        std::cout << "                         into output_root/<name>, sharing one thread pool" << std::endl;
+        std::cout << "  --inspect              Print a JSON summary of each SWF (tag histogram, frames, ABC sizes," << std::endl;
+        std::cout << "                         asset counts) from the tag headers alone; writes nothing" << std::endl;
+        std::cout << "  --memory-budget MB     With --batch, start a file only while the estimated memory of all" << std::endl;
+        std::cout << "                         files in flight fits in MB (default: half the physical memory)" << std::endl;
         return 1;
     }
     
-    SWFExtractor extractor(argv[2]);
+    if (!onlySymbols.empty() || (withDependencies && !onlyIds.empty())) {
+        // Symbols and dependencies are resolved before extraction, from the whole tag stream
+        streaming = false;
+    }
+    
+    if (seekFrame > 0) {
+        // Needs random access to the tags, so never streams
+        streaming = false;
+        if (verbosity == LOG_NORMAL) verbosity = LOG_QUIET;
+    }
+    
+    if (batch) {
+        if (seekFrame > 0) {
+            std::cerr << "--frame cannot be combined with --batch" << std::endl;
+            return 1;
+        }
+        auto configure = [&](SWFExtractor& extractor) {
+            extractor.setStreaming(streaming);
+            extractor.setKeyframeInterval(keyframeInterval);
+            extractor.setIncremental(incremental);
+            extractor.setClassFilter(onlyClasses);
+            extractor.setCharacterFilter(onlyIds, onlySymbols, withDependencies);
+            extractor.setNesting(nestedDepth, nestedMaxSize);
+            if (pack && !extractor.setPackOutput()) return false;
+            if (!storeDir.empty() && !extractor.setStore(storeDir)) return false;
+            return true;
+        };
+        return runBatch(args[0], args[1], jobs, memoryBudget, streaming, verbosity, configure);
+    }
+    
+    SWFExtractor extractor(args[1]);
+    extractor.setStreaming(streaming);
+    extractor.setJobs(jobs);
+    extractor.setVerbosity(verbosity);
+    extractor.setKeyframeInterval(keyframeInterval);
+    extractor.setIncremental(incremental && seekFrame == 0);
+    extractor.setClassFilter(onlyClasses);
+    extractor.setCharacterFilter(onlyIds, onlySymbols, withDependencies);
+    extractor.setNesting(nestedDepth, nestedMaxSize);
+    if (seekFrame > 0) {
+        if (!extractor.loadTimelineIndex()) {
+            std::cerr << "No timeline.swftl in " << args[1] << "; run a full extraction first" << std::endl;
+            return 1;
+        }
+        DisplayList list;
+        if (!extractor.loadSWF(args[0]) || !extractor.displayListAt(seekSprite, seekFrame, list)) {
+            std::cerr << "Frame " << seekFrame << " not found" << std::endl;
+            return 1;
+        }
+        std::cout << describeDisplayList(seekFrame, list);
+        return 0;
+    }
+    
+    if (pack && !extractor.setPackOutput()) {
+        return 1;
+    }
+    
+    if (!storeDir.empty() && !extractor.setStore(storeDir)) {
+        return 1;
+    }
     
-    if (!extractor.loadSWF(argv[1])) {
+    if (!extractor.loadSWF(args[0])) {
         return 1;
     }
     
     extractor.extract();
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <sys/stat.h>
+
+#include "swf_pack.h"
+
+// Lists and unpacks the assets.swfpack files written by `swf_extract --pack`.
+
+static void createDirectory(const std::string& path) {
+    #ifdef _WIN32
+    _mkdir(path.c_str());
+    #else
+    mkdir(path.c_str(), 0755);
+    #endif
+}
+
+static bool isNumber(const std::string& s) {
+    if (s.empty()) return false;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+    }
+    return true;
+}
+
+// Entry names come from the pack index, so a crafted pack could name
+// files outside the output directory. Only relative paths without ".."
+// components are written.
+static bool isSafeEntryName(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\') return false;
+    if (name.find('\0') != std::string::npos) return false;
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find_first_of("/\\", start);
+        if (end == std::string::npos) end = name.size();
+        if (name.compare(start, end - start, "..") == 0) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+static int listPack(PackReader& reader) {
+    std::cout << std::left << std::setw(8) << "ID" << std::setw(14) << "Type"
+              << std::setw(12) << "Size" << "Name" << std::endl;
+    for (const PackEntry& e : reader.entries()) {
+        std::cout << std::left << std::setw(8) << (e.characterId >= 0 ? std::to_string(e.characterId) : "-")
+                  << std::setw(14) << e.type << std::setw(12) << e.length << e.name << std::endl;
+    }
+    std::cout << reader.entries().size() << " entries" << std::endl;
+    return 0;
+}
+
+static bool extractEntry(PackReader& reader, const PackEntry& entry, const std::string& outputDir) {
+    if (!isSafeEntryName(entry.name)) {
+        std::cerr << "Refusing to extract " << entry.name << ": not a path inside the output directory" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    if (!reader.read(entry, bytes)) {
+        std::cerr << "Failed to read " << entry.name << std::endl;
+        return false;
+    }
+
+    // Embedded SWFs are packed under binary_N/ directories
+    for (size_t slash = entry.name.find('/'); slash != std::string::npos; slash = entry.name.find('/', slash + 1)) {
+        createDirectory(outputDir + "/" + entry.name.substr(0, slash));
+    }
+
+    std::string path = outputDir + "/" + entry.name;
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    out.write((const char*)bytes.data(), bytes.size());
+    out.close();
+    std::cout << "Extracted " << path << " (" << bytes.size() << " bytes)" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " list <assets.swfpack>" << std::endl;
+        std::cout << "       " << argv[0] << " extract <assets.swfpack> <output_directory> [name|character_id ...]" << std::endl;
+        return 1;
+    }
+
+    std::string command = argv[1];
+    PackReader reader;
+    if (!reader.open(argv[2])) {
+        std::cerr << "Not a valid pack file: " << argv[2] << std::endl;
+        return 1;
+    }
+
+    if (command == "list") {
+        return listPack(reader);
+    }
+
+    if (command == "extract" && argc >= 4) {
+        std::string outputDir = argv[3];
+        createDirectory(outputDir);
+
+        int failures = 0;
+        if (argc == 4) {
+            for (const PackEntry& e : reader.entries()) {
+                if (!extractEntry(reader, e, outputDir)) failures++;
+            }
+        } else {
+            for (int i = 4; i < argc; i++) {
+                std::string key = argv[i];
+                const PackEntry* entry = reader.find(key);
+                if (!entry && isNumber(key)) entry = reader.findCharacter(std::atoi(key.c_str()));
+                if (!entry) {
+                    std::cerr << "No entry named " << key << std::endl;
+                    failures++;
+                    continue;
+                }
+                if (!extractEntry(reader, *entry, outputDir)) failures++;
+            }
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    std::cerr << "Unknown command: " << command << std::endl;
+    return 1;
+}
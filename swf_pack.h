@@ -0,0 +1,227 @@
+#ifndef SWF_PACK_H
+#define SWF_PACK_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// ==========================================
+// Pack File Format
+// ==========================================
+//
+// Single-file asset container written by `swf_extract --pack`. Assets are
+// appended back to back and located through an index at the end of the
+// file, so readers get random access without scanning directories.
+//
+// Layout (all integers little-endian):
+//
+//   "SWFPACK1"                      8-byte magic
+//   payloads                        back to back, in write order
+//   index, one record per entry:
+//     u64 offset                    from the start of the file
+//     u64 length
+//     i32 characterId               -1 for files that are not characters
+//     u16 nameLength
+//     u16 typeLength
+//     u32 metadataLength
+//     name, type, metadata          raw bytes, not terminated
+//   trailer:
+//     u64 indexOffset
+//     u32 entryCount
+//     u32 reserved                  0
+//     "SWFPACKI"                    8-byte magic
+//
+// The name is the path the asset would have had relative to the output
+// directory (e.g. "shape_12.dat"); metadata carries the asset's
+// manifest.jsonl record.
+
+static const char PACK_MAGIC[8] = {'S', 'W', 'F', 'P', 'A', 'C', 'K', '1'};
+static const char PACK_INDEX_MAGIC[8] = {'S', 'W', 'F', 'P', 'A', 'C', 'K', 'I'};
+static const size_t PACK_TRAILER_SIZE = 24;
+
+struct PackEntry {
+    std::string name;
+    std::string type;
+    std::string metadata;
+    int32_t characterId;
+    uint64_t offset;
+    uint64_t length;
+
+    PackEntry() : characterId(-1), offset(0), length(0) {}
+};
+
+class PackWriter {
+    std::ofstream out;
+    std::vector<PackEntry> entries;
+    uint64_t position;
+
+    void putU16(std::string& buf, uint16_t v) {
+        buf += (char)(v & 0xFF);
+        buf += (char)(v >> 8);
+    }
+
+    void putU32(std::string& buf, uint32_t v) {
+        for (int i = 0; i < 4; i++) buf += (char)((v >> (8 * i)) & 0xFF);
+    }
+
+    void putU64(std::string& buf, uint64_t v) {
+        for (int i = 0; i < 8; i++) buf += (char)((v >> (8 * i)) & 0xFF);
+    }
+
+public:
+    PackWriter() : position(0) {}
+
+    bool open(const std::string& path) {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(PACK_MAGIC, sizeof(PACK_MAGIC));
+        position = sizeof(PACK_MAGIC);
+        entries.clear();
+        return out.good();
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    // An entry is written as beginEntry, any number of write calls, endEntry
+    void beginEntry(const std::string& name, const std::string& type, int32_t characterId,
+                    const std::string& metadata) {
+        PackEntry entry;
+        entry.name = name;
+        entry.type = type;
+        entry.metadata = metadata;
+        entry.characterId = characterId;
+        entry.offset = position;
+        entries.push_back(entry);
+    }
+
+    void write(const uint8_t* data, size_t size) {
+        out.write((const char*)data, size);
+        position += size;
+    }
+
+    bool endEntry() {
+        entries.back().length = position - entries.back().offset;
+        return out.good();
+    }
+
+    // Writes the index and trailer
+    bool close() {
+        if (!out.is_open()) return false;
+        uint64_t indexOffset = position;
+        std::string index;
+        for (const PackEntry& e : entries) {
+            putU64(index, e.offset);
+            putU64(index, e.length);
+            putU32(index, (uint32_t)e.characterId);
+            putU16(index, (uint16_t)e.name.size());
+            putU16(index, (uint16_t)e.type.size());
+            putU32(index, (uint32_t)e.metadata.size());
+            index += e.name;
+            index += e.type;
+            index += e.metadata;
+        }
+        putU64(index, indexOffset);
+        putU32(index, (uint32_t)entries.size());
+        putU32(index, 0);
+        index.append(PACK_INDEX_MAGIC, sizeof(PACK_INDEX_MAGIC));
+        out.write(index.data(), index.size());
+        out.close();
+        return !out.fail();
+    }
+};
+
+class PackReader {
+    std::ifstream in;
+    std::vector<PackEntry> entryList;
+    std::map<std::string, size_t> byName;
+
+    static uint64_t getU(const uint8_t* p, int bytes) {
+        uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+        return v;
+    }
+
+public:
+    bool open(const std::string& path) {
+        in.open(path, std::ios::binary);
+        if (!in.is_open()) return false;
+
+        in.seekg(0, std::ios::end);
+        uint64_t fileSize = in.tellg();
+        if (fileSize < sizeof(PACK_MAGIC) + PACK_TRAILER_SIZE) return false;
+
+        char magic[8];
+        in.seekg(0, std::ios::beg);
+        in.read(magic, 8);
+        if (memcmp(magic, PACK_MAGIC, 8) != 0) return false;
+
+        uint8_t trailer[PACK_TRAILER_SIZE];
+        in.seekg(fileSize - PACK_TRAILER_SIZE, std::ios::beg);
+        in.read((char*)trailer, PACK_TRAILER_SIZE);
+        if (memcmp(trailer + 16, PACK_INDEX_MAGIC, 8) != 0) return false;
+
+        uint64_t indexOffset = getU(trailer, 8);
+        uint32_t count = (uint32_t)getU(trailer + 8, 4);
+        uint64_t indexEnd = fileSize - PACK_TRAILER_SIZE;
+        if (indexOffset > indexEnd) return false;
+
+        std::vector<uint8_t> index(indexEnd - indexOffset);
+        in.seekg(indexOffset, std::ios::beg);
+        in.read((char*)index.data(), index.size());
+
+        entryList.clear();
+        byName.clear();
+        size_t pos = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (pos + 28 > index.size()) return false;
+            const uint8_t* rec = &index[pos];
+            PackEntry e;
+            e.offset = getU(rec, 8);
+            e.length = getU(rec + 8, 8);
+            e.characterId = (int32_t)getU(rec + 16, 4);
+            size_t nameLength = getU(rec + 20, 2);
+            size_t typeLength = getU(rec + 22, 2);
+            size_t metaLength = getU(rec + 24, 4);
+            pos += 28;
+            if (pos + nameLength + typeLength + metaLength > index.size()) return false;
+            e.name.assign((const char*)&index[pos], nameLength);
+            pos += nameLength;
+            e.type.assign((const char*)&index[pos], typeLength);
+            pos += typeLength;
+            e.metadata.assign((const char*)&index[pos], metaLength);
+            pos += metaLength;
+            if (e.offset + e.length > indexOffset) return false;
+            byName[e.name] = entryList.size();
+            entryList.push_back(e);
+        }
+        return true;
+    }
+
+    const std::vector<PackEntry>& entries() const { return entryList; }
+
+    const PackEntry* find(const std::string& name) const {
+        auto it = byName.find(name);
+        return it == byName.end() ? nullptr : &entryList[it->second];
+    }
+
+    // First entry for the character, skipping non-character files
+    const PackEntry* findCharacter(int32_t characterId) const {
+        for (const PackEntry& e : entryList) {
+            if (e.characterId == characterId) return &e;
+        }
+        return nullptr;
+    }
+
+    bool read(const PackEntry& entry, std::vector<uint8_t>& out) {
+        out.resize(entry.length);
+        in.clear();
+        in.seekg(entry.offset, std::ios::beg);
+        in.read((char*)out.data(), entry.length);
+        return (uint64_t)in.gcount() == entry.length;
+    }
+};
+
+#endif
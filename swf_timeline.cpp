@@ -0,0 +1,97 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+#include "swf_pack.h"
+#include "swf_timeline.h"
+
+// Rebuilds display lists from the timeline.swftl written by swf_extract,
+// either loose or inside an assets.swfpack.
+
+static bool loadTimeline(const std::string& path, TimelineReader& reader) {
+    PackReader pack;
+    if (pack.open(path)) {
+        const PackEntry* entry = pack.find("timeline.swftl");
+        std::vector<uint8_t> bytes;
+        if (!entry || !pack.read(*entry, bytes)) return false;
+        return reader.load(std::move(bytes));
+    }
+    return reader.open(path);
+}
+
+int main(int argc, char* argv[]) {
+    int32_t track = MAIN_TIMELINE;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sprite" && i + 1 < argc) {
+            track = std::atoi(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() < 2) {
+        std::cout << "Usage: " << argv[0] << " info <timeline.swftl|assets.swfpack>" << std::endl;
+        std::cout << "       " << argv[0] << " [--sprite ID] frame <timeline.swftl|assets.swfpack> <frame> [frame ...]" << std::endl;
+        std::cout << "       " << argv[0] << " [--sprite ID] all <timeline.swftl|assets.swfpack>" << std::endl;
+        return 1;
+    }
+
+    std::string command = args[0];
+    TimelineReader reader;
+    if (!loadTimeline(args[1], reader)) {
+        std::cerr << "Not a valid timeline file: " << args[1] << std::endl;
+        return 1;
+    }
+
+    if (command == "info") {
+        for (auto& pair : reader.timelines()) {
+            const TimelineReader::Track& t = pair.second;
+            if (pair.first == MAIN_TIMELINE) {
+                std::cout << "Main timeline: ";
+            } else {
+                std::cout << "Sprite " << pair.first << ": ";
+            }
+            std::cout << t.frames << " frames, " << t.keyframes.size()
+                      << " keyframes (every " << t.interval << " frames)" << std::endl;
+        }
+        return 0;
+    }
+
+    if (!reader.timelines().count(track)) {
+        std::cerr << "No timeline for sprite " << track << std::endl;
+        return 1;
+    }
+
+    if (command == "frame" && args.size() >= 3) {
+        int failures = 0;
+        DisplayList list;
+        for (size_t i = 2; i < args.size(); i++) {
+            uint32_t frameNum = (uint32_t)std::strtoul(args[i].c_str(), nullptr, 10);
+            if (!reader.displayListAt(track, frameNum, list)) {
+                std::cerr << "No frame " << args[i] << " (timeline has " << reader.frameCount(track) << " frames)" << std::endl;
+                failures++;
+                continue;
+            }
+            std::cout << describeDisplayList(frameNum, list);
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (command == "all") {
+        bool ok = reader.forEachFrame(track, [](uint32_t frameNum, const DisplayList& list) {
+            std::cout << describeDisplayList(frameNum, list);
+        });
+        if (!ok) {
+            std::cerr << "Timeline is corrupt" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::cerr << "Unknown command: " << command << std::endl;
+    return 1;
+}
@@ -0,0 +1,517 @@
+#ifndef SWF_TIMELINE_H
+#define SWF_TIMELINE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ==========================================
+// Display List
+// ==========================================
+
+struct Matrix {
+    double a, b, c, d, tx, ty;
+    Matrix() : a(1), b(0), c(0), d(1), tx(0), ty(0) {}
+
+    bool operator==(const Matrix& o) const {
+        return a == o.a && b == o.b && c == o.c && d == o.d && tx == o.tx && ty == o.ty;
+    }
+};
+
+struct ColorTransform {
+    int rMult, gMult, bMult, aMult;
+    int rAdd, gAdd, bAdd, aAdd;
+    ColorTransform() : rMult(256), gMult(256), bMult(256), aMult(256),
+                       rAdd(0), gAdd(0), bAdd(0), aAdd(0) {}
+
+    bool operator==(const ColorTransform& o) const {
+        return rMult == o.rMult && gMult == o.gMult && bMult == o.bMult && aMult == o.aMult
+            && rAdd == o.rAdd && gAdd == o.gAdd && bAdd == o.bAdd && aAdd == o.aAdd;
+    }
+};
+
+struct DisplayObject {
+    uint16_t characterId;
+    uint16_t depth;
+    Matrix matrix;
+    ColorTransform colorTransform;
+    std::string name;
+
+    DisplayObject() : characterId(0), depth(0) {}
+};
+
+typedef std::map<uint16_t, DisplayObject> DisplayList;
+
+// ==========================================
+// Timeline File Format
+// ==========================================
+//
+// Written by swf_extract as timeline.swftl. The file holds one track per
+// timeline: the main movie and every DefineSprite. Instead of a full dump
+// of the display list per frame, each frame stores only what changed
+// since the previous one. Every keyframeInterval frames (starting with
+// frame 1) a complete snapshot is stored instead, so any frame can be
+// rebuilt by replaying at most keyframeInterval - 1 deltas.
+//
+// Each frame also lists the PlaceObject/RemoveObject tags that produced
+// it, by offset in the uncompressed SWF. A reader holding the SWF can
+// start from a keyframe snapshot and replay just those tags.
+//
+// Layout (all integers little-endian):
+//
+//   "SWFTL002"                      8-byte magic
+//   frame records, track by track, frame 1 first:
+//     u8  kind                      0 = delta, 1 = keyframe (clears the list)
+//     u32 opCount
+//     ops:
+//       u8  op                      1 = place, 2 = modify, 3 = remove
+//       u16 depth
+//       place and modify only:
+//         u8 fields                 1 = character, 2 = matrix,
+//                                   4 = color transform, 8 = name
+//         u16 characterId           if fields & 1
+//         f64 a, b, c, d, tx, ty    if fields & 2
+//         i16 rMult, gMult, bMult, aMult, rAdd, gAdd, bAdd, aAdd
+//                                   if fields & 4
+//         u16 nameLength, name      if fields & 8
+//     u32 tagCount
+//     tags:
+//       u16 tagType
+//       u32 length                  payload length
+//       u64 offset                  of the payload, header included in the count
+//   track index, one record per track:
+//     i32 id                        sprite character id, -1 for the main timeline
+//     u32 frameCount
+//     u32 keyframeInterval
+//     u32 keyframeCount
+//     keyframes:
+//       u32 frame
+//       u64 offset                  of the frame record
+//   trailer:
+//     u64 indexOffset
+//     u32 trackCount
+//     u32 reserved                  0
+//     "SWFTLIDX"                    8-byte magic
+//
+// A place starts from a default object (identity matrix and color
+// transform, no name) and only carries the fields that differ from it;
+// a modify carries the fields that differ from the object already at
+// that depth.
+
+static const char TIMELINE_MAGIC[8] = {'S', 'W', 'F', 'T', 'L', '0', '0', '2'};
+static const char TIMELINE_INDEX_MAGIC[8] = {'S', 'W', 'F', 'T', 'L', 'I', 'D', 'X'};
+static const size_t TIMELINE_TRAILER_SIZE = 24;
+static const int32_t MAIN_TIMELINE = -1;
+
+enum TimelineOp {
+    TIMELINE_PLACE = 1,
+    TIMELINE_MODIFY = 2,
+    TIMELINE_REMOVE = 3
+};
+
+enum TimelineField {
+    FIELD_CHARACTER = 1,
+    FIELD_MATRIX = 2,
+    FIELD_COLOR_TRANSFORM = 4,
+    FIELD_NAME = 8
+};
+
+// A display-list tag in the source SWF
+struct TimelineTag {
+    uint16_t type;
+    uint32_t length;
+    uint64_t offset;
+};
+
+inline void timelinePut(std::string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out += (char)((v >> (8 * i)) & 0xFF);
+}
+
+// Records one track. Frame records are kept in memory until
+// buildTimelineFile() lays out all tracks.
+class TimelineWriter {
+    std::string out;
+    DisplayList shown;                // State as of the last frame written
+    std::set<uint16_t> touched;       // Depths changed since then
+    std::vector<TimelineTag> tags;    // Display-list tags since then
+    std::vector<std::pair<uint32_t, uint64_t>> keyframes;   // Offsets into out
+    uint32_t frames;
+    uint32_t interval;
+
+    void putF64(double v) {
+        uint64_t bits;
+        memcpy(&bits, &v, 8);
+        timelinePut(out, bits, 8);
+    }
+
+    void putObject(uint8_t op, const DisplayObject& obj, const DisplayObject& base) {
+        uint8_t fields = 0;
+        if (obj.characterId != base.characterId) fields |= FIELD_CHARACTER;
+        if (!(obj.matrix == base.matrix)) fields |= FIELD_MATRIX;
+        if (!(obj.colorTransform == base.colorTransform)) fields |= FIELD_COLOR_TRANSFORM;
+        if (obj.name != base.name) fields |= FIELD_NAME;
+
+        timelinePut(out, op, 1);
+        timelinePut(out, obj.depth, 2);
+        timelinePut(out, fields, 1);
+        if (fields & FIELD_CHARACTER) timelinePut(out, obj.characterId, 2);
+        if (fields & FIELD_MATRIX) {
+            const Matrix& m = obj.matrix;
+            putF64(m.a); putF64(m.b); putF64(m.c); putF64(m.d); putF64(m.tx); putF64(m.ty);
+        }
+        if (fields & FIELD_COLOR_TRANSFORM) {
+            const ColorTransform& ct = obj.colorTransform;
+            int values[8] = {ct.rMult, ct.gMult, ct.bMult, ct.aMult, ct.rAdd, ct.gAdd, ct.bAdd, ct.aAdd};
+            for (int v : values) timelinePut(out, (uint16_t)v, 2);
+        }
+        if (fields & FIELD_NAME) {
+            size_t length = std::min<size_t>(obj.name.size(), 0xFFFF);
+            timelinePut(out, length, 2);
+            out.append(obj.name, 0, length);
+        }
+    }
+
+    void putTags() {
+        timelinePut(out, tags.size(), 4);
+        for (const TimelineTag& t : tags) {
+            timelinePut(out, t.type, 2);
+            timelinePut(out, t.length, 4);
+            timelinePut(out, t.offset, 8);
+        }
+        tags.clear();
+        touched.clear();
+    }
+
+public:
+    explicit TimelineWriter(uint32_t keyframeInterval = 64)
+        : frames(0), interval(keyframeInterval ? keyframeInterval : 1) {}
+
+    void setKeyframeInterval(uint32_t frameCount) { interval = frameCount ? frameCount : 1; }
+
+    // Records a PlaceObject/RemoveObject tag that changed depth
+    void addTag(uint16_t depth, uint16_t type, uint32_t length, uint64_t offset) {
+        touched.insert(depth);
+        tags.push_back(TimelineTag{type, length, offset});
+    }
+
+    // Appends the next frame; list is the display list at its ShowFrame.
+    // Only touched depths are compared, so unchanged objects cost nothing.
+    // Returns the number of ops written.
+    uint32_t addFrame(const DisplayList& list) {
+        frames++;
+        uint32_t ops = 0;
+
+        if ((frames - 1) % interval == 0) {
+            keyframes.push_back(std::make_pair(frames, (uint64_t)out.size()));
+            timelinePut(out, 1, 1);
+            timelinePut(out, list.size(), 4);
+            DisplayObject blank;
+            for (auto& pair : list) {
+                blank.depth = pair.first;
+                putObject(TIMELINE_PLACE, pair.second, blank);
+            }
+            ops = (uint32_t)list.size();
+            shown = list;
+            putTags();
+            return ops;
+        }
+
+        timelinePut(out, 0, 1);
+        size_t countAt = out.size();
+        timelinePut(out, 0, 4);
+        DisplayObject blank;
+        for (uint16_t depth : touched) {
+            auto now = list.find(depth);
+            auto before = shown.find(depth);
+            if (now == list.end()) {
+                if (before == shown.end()) continue;
+                timelinePut(out, TIMELINE_REMOVE, 1);
+                timelinePut(out, depth, 2);
+                shown.erase(before);
+            } else if (before == shown.end()) {
+                blank.depth = depth;
+                putObject(TIMELINE_PLACE, now->second, blank);
+                shown[depth] = now->second;
+            } else {
+                const DisplayObject& a = now->second;
+                const DisplayObject& b = before->second;
+                if (a.characterId == b.characterId && a.matrix == b.matrix &&
+                    a.colorTransform == b.colorTransform && a.name == b.name) continue;
+                putObject(TIMELINE_MODIFY, a, b);
+                before->second = a;
+            }
+            ops++;
+        }
+        for (int i = 0; i < 4; i++) out[countAt + i] = (char)((ops >> (8 * i)) & 0xFF);
+        putTags();
+        return ops;
+    }
+
+    uint32_t frameCount() const { return frames; }
+    uint32_t keyframeInterval() const { return interval; }
+    const std::string& records() const { return out; }
+    const std::vector<std::pair<uint32_t, uint64_t>>& keyframeOffsets() const { return keyframes; }
+};
+
+// Lays out the tracks (id, writer) into a complete timeline file
+inline std::string buildTimelineFile(const std::vector<std::pair<int32_t, const TimelineWriter*>>& tracks) {
+    std::string file(TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC));
+    std::vector<uint64_t> starts;
+    for (auto& track : tracks) {
+        starts.push_back(file.size());
+        file += track.second->records();
+    }
+
+    uint64_t indexOffset = file.size();
+    for (size_t i = 0; i < tracks.size(); i++) {
+        const TimelineWriter& w = *tracks[i].second;
+        timelinePut(file, (uint32_t)tracks[i].first, 4);
+        timelinePut(file, w.frameCount(), 4);
+        timelinePut(file, w.keyframeInterval(), 4);
+        timelinePut(file, w.keyframeOffsets().size(), 4);
+        for (auto& k : w.keyframeOffsets()) {
+            timelinePut(file, k.first, 4);
+            timelinePut(file, starts[i] + k.second, 8);
+        }
+    }
+    timelinePut(file, indexOffset, 8);
+    timelinePut(file, tracks.size(), 4);
+    timelinePut(file, 0, 4);
+    file.append(TIMELINE_INDEX_MAGIC, sizeof(TIMELINE_INDEX_MAGIC));
+    return file;
+}
+
+class TimelineReader {
+public:
+    struct Track {
+        uint32_t frames;
+        uint32_t interval;
+        std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+    };
+
+private:
+    std::vector<uint8_t> bytes;
+    std::map<int32_t, Track> tracks;
+    uint64_t indexOffset;
+
+    static uint64_t getU(const uint8_t* p, int n) {
+        uint64_t v = 0;
+        for (int i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+        return v;
+    }
+
+    bool has(size_t pos, size_t n) const { return pos + n <= indexOffset; }
+
+    // Decodes one frame record at pos. The ops are applied to list unless
+    // it is null; the frame's source tags are appended to tags if given.
+    bool applyFrame(size_t& pos, DisplayList* list, std::vector<TimelineTag>* tags) const {
+        if (!has(pos, 5)) return false;
+        uint8_t kind = bytes[pos];
+        uint32_t ops = (uint32_t)getU(&bytes[pos + 1], 4);
+        pos += 5;
+        if (kind == 1 && list) list->clear();
+
+        for (uint32_t i = 0; i < ops; i++) {
+            if (!has(pos, 3)) return false;
+            uint8_t op = bytes[pos];
+            uint16_t depth = (uint16_t)getU(&bytes[pos + 1], 2);
+            pos += 3;
+            if (op == TIMELINE_REMOVE) {
+                if (list) list->erase(depth);
+                continue;
+            }
+            if (!has(pos, 1)) return false;
+            uint8_t fields = bytes[pos++];
+
+            DisplayObject obj;
+            if (op == TIMELINE_MODIFY && list) {
+                auto it = list->find(depth);
+                if (it != list->end()) obj = it->second;
+            }
+            obj.depth = depth;
+            if (fields & FIELD_CHARACTER) {
+                if (!has(pos, 2)) return false;
+                obj.characterId = (uint16_t)getU(&bytes[pos], 2);
+                pos += 2;
+            }
+            if (fields & FIELD_MATRIX) {
+                if (!has(pos, 48)) return false;
+                double* m[6] = {&obj.matrix.a, &obj.matrix.b, &obj.matrix.c,
+                                &obj.matrix.d, &obj.matrix.tx, &obj.matrix.ty};
+                for (int k = 0; k < 6; k++) {
+                    uint64_t v = getU(&bytes[pos + 8 * k], 8);
+                    memcpy(m[k], &v, 8);
+                }
+                pos += 48;
+            }
+            if (fields & FIELD_COLOR_TRANSFORM) {
+                if (!has(pos, 16)) return false;
+                int* c[8] = {&obj.colorTransform.rMult, &obj.colorTransform.gMult,
+                             &obj.colorTransform.bMult, &obj.colorTransform.aMult,
+                             &obj.colorTransform.rAdd, &obj.colorTransform.gAdd,
+                             &obj.colorTransform.bAdd, &obj.colorTransform.aAdd};
+                for (int k = 0; k < 8; k++) *c[k] = (int16_t)getU(&bytes[pos + 2 * k], 2);
+                pos += 16;
+            }
+            if (fields & FIELD_NAME) {
+                if (!has(pos, 2)) return false;
+                size_t length = getU(&bytes[pos], 2);
+                pos += 2;
+                if (!has(pos, length)) return false;
+                obj.name.assign((const char*)&bytes[pos], length);
+                pos += length;
+            }
+            if (list) (*list)[depth] = obj;
+        }
+
+        if (!has(pos, 4)) return false;
+        uint32_t tagCount = (uint32_t)getU(&bytes[pos], 4);
+        pos += 4;
+        if ((indexOffset - pos) / 14 < tagCount) return false;
+        if (tags) {
+            for (uint32_t i = 0; i < tagCount; i++) {
+                const uint8_t* t = &bytes[pos + 14 * i];
+                tags->push_back(TimelineTag{(uint16_t)getU(t, 2), (uint32_t)getU(t + 2, 4), getU(t + 6, 8)});
+            }
+        }
+        pos += 14 * (size_t)tagCount;
+        return true;
+    }
+
+    // Offset of the keyframe at or before frame
+    const std::pair<uint32_t, uint64_t>* keyframeFor(int32_t id, uint32_t frame) const {
+        auto it = tracks.find(id);
+        if (it == tracks.end()) return nullptr;
+        const Track& t = it->second;
+        if (frame < 1 || frame > t.frames) return nullptr;
+        auto k = std::upper_bound(t.keyframes.begin(), t.keyframes.end(), std::make_pair(frame, UINT64_MAX));
+        if (k == t.keyframes.begin()) return nullptr;
+        return &*(k - 1);
+    }
+
+public:
+    TimelineReader() : indexOffset(0) {}
+
+    bool load(std::vector<uint8_t>&& file) {
+        bytes.swap(file);
+        tracks.clear();
+        if (bytes.size() < sizeof(TIMELINE_MAGIC) + TIMELINE_TRAILER_SIZE) return false;
+        if (memcmp(bytes.data(), TIMELINE_MAGIC, 8) != 0) return false;
+
+        const uint8_t* trailer = bytes.data() + bytes.size() - TIMELINE_TRAILER_SIZE;
+        if (memcmp(trailer + 16, TIMELINE_INDEX_MAGIC, 8) != 0) return false;
+        indexOffset = getU(trailer, 8);
+        uint32_t trackCount = (uint32_t)getU(trailer + 8, 4);
+
+        uint64_t indexEnd = bytes.size() - TIMELINE_TRAILER_SIZE;
+        if (indexOffset > indexEnd) return false;
+        size_t pos = indexOffset;
+        for (uint32_t i = 0; i < trackCount; i++) {
+            if (pos + 16 > indexEnd) return false;
+            int32_t id = (int32_t)getU(&bytes[pos], 4);
+            Track t;
+            t.frames = (uint32_t)getU(&bytes[pos + 4], 4);
+            t.interval = (uint32_t)getU(&bytes[pos + 8], 4);
+            uint32_t keyframeCount = (uint32_t)getU(&bytes[pos + 12], 4);
+            pos += 16;
+            if ((indexEnd - pos) / 12 < keyframeCount) return false;
+            for (uint32_t k = 0; k < keyframeCount; k++) {
+                uint32_t frame = (uint32_t)getU(&bytes[pos], 4);
+                uint64_t offset = getU(&bytes[pos + 4], 8);
+                pos += 12;
+                if (offset >= indexOffset) return false;
+                t.keyframes.push_back(std::make_pair(frame, offset));
+            }
+            tracks[id] = t;
+        }
+        return true;
+    }
+
+    bool open(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return false;
+        std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return load(std::move(file));
+    }
+
+    const std::map<int32_t, Track>& timelines() const { return tracks; }
+
+    uint32_t frameCount(int32_t id = MAIN_TIMELINE) const {
+        auto it = tracks.find(id);
+        return it == tracks.end() ? 0 : it->second.frames;
+    }
+
+    // Rebuilds the display list shown at frame (1-based) from the nearest
+    // keyframe at or before it
+    bool displayListAt(int32_t id, uint32_t frame, DisplayList& list) const {
+        list.clear();
+        const std::pair<uint32_t, uint64_t>* k = keyframeFor(id, frame);
+        if (!k) return false;
+        size_t pos = k->second;
+        for (uint32_t f = k->first; f <= frame; f++) {
+            if (!applyFrame(pos, &list, nullptr)) return false;
+        }
+        return true;
+    }
+
+    // Snapshot at the keyframe nearest to frame, plus the source tags of
+    // the frames after it up to and including frame. Replaying those tags
+    // from the SWF on top of the snapshot yields the display list at frame.
+    bool seek(int32_t id, uint32_t frame, DisplayList& snapshot, std::vector<TimelineTag>& tags) const {
+        snapshot.clear();
+        tags.clear();
+        const std::pair<uint32_t, uint64_t>* k = keyframeFor(id, frame);
+        if (!k) return false;
+        size_t pos = k->second;
+        if (!applyFrame(pos, &snapshot, nullptr)) return false;
+        for (uint32_t f = k->first + 1; f <= frame; f++) {
+            if (!applyFrame(pos, nullptr, &tags)) return false;
+        }
+        return true;
+    }
+
+    // Calls fn(frame, list) for every frame of a track in order, applying
+    // each record once
+    template <typename Fn>
+    bool forEachFrame(int32_t id, Fn fn) const {
+        auto it = tracks.find(id);
+        if (it == tracks.end()) return false;
+        if (it->second.frames == 0) return true;
+        if (it->second.keyframes.empty()) return false;
+        size_t pos = it->second.keyframes.front().second;
+        DisplayList list;
+        for (uint32_t f = 1; f <= it->second.frames; f++) {
+            if (!applyFrame(pos, &list, nullptr)) return false;
+            fn(f, list);
+        }
+        return true;
+    }
+};
+
+// Text form of a display list, as the per-frame dumps used to look
+inline std::string describeDisplayList(uint32_t frameNum, const DisplayList& list) {
+    std::ostringstream out;
+    out << "=== FRAME " << frameNum << " DISPLAY LIST ===" << "\n\n";
+    for (auto& pair : list) {
+        const DisplayObject& obj = pair.second;
+        out << "Depth: " << obj.depth << "\n";
+        out << "  Character ID: " << obj.characterId << "\n";
+        out << "  Matrix: [" << obj.matrix.a << ", " << obj.matrix.b << ", "
+            << obj.matrix.c << ", " << obj.matrix.d << ", "
+            << obj.matrix.tx << ", " << obj.matrix.ty << "]\n";
+        if (!obj.name.empty()) {
+            out << "  Name: " << obj.name << "\n";
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+#endif
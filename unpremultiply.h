@@ -0,0 +1,124 @@
+#ifndef UNPREMULTIPLY_H
+#define UNPREMULTIPLY_H
+
+#include <cstdint>
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SWF_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// ==========================================
+// Premultiplied ARGB to straight RGBA
+// ==========================================
+
+// Used by swf_extractor for DefineBitsLossless2 and checked against the
+// scalar reference by bench_unpremultiply.
+
+// DefineBitsLossless2 stores premultiplied ARGB. Each channel becomes
+// c * 255 / a rounded half up, clamped to 255, and 0 when alpha is 0.
+// In single precision c * 255 is exact and the division is correctly
+// rounded, so floor(q + 0.5) matches exact integer rounding. The SIMD
+// kernels evaluate the same expression and produce identical bytes;
+// this function is the reference.
+inline uint8_t unpremultiplyChannel(uint8_t c, uint8_t a) {
+    if (a == 0) return 0;
+    int v = (int)((float)(c * 255) / (float)a + 0.5f);
+    return v > 255 ? 255 : (uint8_t)v;
+}
+
+inline void argbToRgbaScalar(uint8_t* p, size_t count) {
+    for (size_t i = 0; i < count; i++, p += 4) {
+        uint8_t a = p[0];
+        p[0] = unpremultiplyChannel(p[1], a);
+        p[1] = unpremultiplyChannel(p[2], a);
+        p[2] = unpremultiplyChannel(p[3], a);
+        p[3] = a;
+    }
+}
+
+#ifdef SWF_X86_SIMD
+// 4 pixels per iteration. Bytes are rotated ARGB -> RGBA with two
+// shifts and widened to one float vector per pixel. That vector is
+// multiplied by 255, divided by (a, a, a, 255), offset by 0.5,
+// truncated, and narrowed back with saturation. When a = 0 the result
+// is inf or NaN, which converts to INT_MIN and saturates to 0.
+__attribute__((target("sse2")))
+inline void argbToRgbaSSE2(uint8_t* p, size_t count) {
+    const __m128 k255 = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 alphaLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + 4 * i));
+        v = _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i px[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                         _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+        for (int k = 0; k < 4; k++) {
+            __m128 f = _mm_cvtepi32_ps(px[k]);
+            __m128 alpha = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 divisor = _mm_or_ps(_mm_andnot_ps(alphaLane, alpha), _mm_and_ps(alphaLane, k255));
+            __m128 q = _mm_div_ps(_mm_mul_ps(f, k255), divisor);
+            px[k] = _mm_cvttps_epi32(_mm_add_ps(q, half));
+        }
+        __m128i out = _mm_packus_epi16(_mm_packs_epi32(px[0], px[1]), _mm_packs_epi32(px[2], px[3]));
+        _mm_storeu_si128((__m128i*)(p + 4 * i), out);
+    }
+    argbToRgbaScalar(p + 4 * i, count - i);
+}
+
+// Same as the SSE2 kernel on 8 pixels. Unpacks and packs stay within
+// 128-bit lanes, so each lane holds one pixel per vector and the packs
+// put the pixels back in order without a permute.
+__attribute__((target("avx2")))
+inline void argbToRgbaAVX2(uint8_t* p, size_t count) {
+    const __m256 k255 = _mm256_set1_ps(255.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 alphaLane = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + 4 * i));
+        v = _mm256_or_si256(_mm256_srli_epi32(v, 8), _mm256_slli_epi32(v, 24));
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        __m256i px[4] = {_mm256_unpacklo_epi16(lo, zero), _mm256_unpackhi_epi16(lo, zero),
+                         _mm256_unpacklo_epi16(hi, zero), _mm256_unpackhi_epi16(hi, zero)};
+        for (int k = 0; k < 4; k++) {
+            __m256 f = _mm256_cvtepi32_ps(px[k]);
+            __m256 alpha = _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 q = _mm256_div_ps(_mm256_mul_ps(f, k255), _mm256_blendv_ps(alpha, k255, alphaLane));
+            px[k] = _mm256_cvttps_epi32(_mm256_add_ps(q, half));
+        }
+        __m256i out = _mm256_packus_epi16(_mm256_packs_epi32(px[0], px[1]), _mm256_packs_epi32(px[2], px[3]));
+        _mm256_storeu_si256((__m256i*)(p + 4 * i), out);
+    }
+    argbToRgbaSSE2(p + 4 * i, count - i);
+}
+#endif
+
+// Converts count premultiplied ARGB pixels to straight RGBA in place,
+// using the widest kernel the CPU supports
+inline void argbToRgba(uint8_t* pixels, size_t count) {
+#ifdef SWF_X86_SIMD
+    static const int level = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+    }();
+    if (level == 2) {
+        argbToRgbaAVX2(pixels, count);
+        return;
+    }
+    if (level == 1) {
+        argbToRgbaSSE2(pixels, count);
+        return;
+    }
+#endif
+    argbToRgbaScalar(pixels, count);
+}
+
+#endif